@@ -22,7 +22,7 @@ static void scalePoints(Point *pt, int count, int scale) {
 }
 
 Cutscene::Cutscene(Resource *res, SystemStub *stub, Video *vid)
-	: _res(res), _stub(stub), _vid(vid) {
+	: _res(res), _stub(stub), _vid(vid), _pacer(stub) {
 	_patchedOffsetsTable = 0;
 	memset(_palBuf, 0, sizeof(_palBuf));
 }
@@ -42,12 +42,7 @@ void Cutscene::sync() {
 	if (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) {
 		return;
 	}
-	const int32_t delay = _stub->getTimeStamp() - _tstamp;
-	const int32_t pause = _frameDelay * TIMER_SLICE - delay;
-	if (pause > 0) {
-		_stub->sleep(pause);
-	}
-	_tstamp = _stub->getTimeStamp();
+	_pacer.waitMs(_frameDelay * TIMER_SLICE);
 }
 
 void Cutscene::copyPalette(const uint8_t *pal, uint16_t num) {
@@ -960,7 +955,7 @@ uint16_t Cutscene::fetchNextCmdWord() {
 
 void Cutscene::mainLoop(uint16_t num) {
 	_frameDelay = 5;
-	_tstamp = _stub->getTimeStamp();
+	_pacer.reset();
 
 	Color c;
 	c.r = c.g = c.b = 0;
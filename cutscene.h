@@ -8,6 +8,7 @@
 #define CUTSCENE_H__
 
 #include "intern.h"
+#include "frame_pacer.h"
 #include "graphics.h"
 
 struct Resource;
@@ -68,7 +69,7 @@ struct Cutscene {
 	const uint8_t *_polPtr;
 	const uint8_t *_cmdPtr;
 	const uint8_t *_cmdPtrBak;
-	uint32_t _tstamp;
+	FramePacer _pacer;
 	uint8_t _frameDelay;
 	bool _newPal;
 	uint8_t _palBuf[16 * sizeof(uint16_t) * 2];
@@ -5,6 +5,13 @@
  */
 
 #include <sys/param.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <SDL_atomic.h>
 #include "file.h"
 #include "fs.h"
 #include "util.h"
@@ -26,6 +33,7 @@ struct File_impl {
 	virtual void seek(int32_t off) = 0;
 	virtual uint32_t read(void *ptr, uint32_t len) = 0;
 	virtual uint32_t write(const void *ptr, uint32_t len) = 0;
+	virtual uint8_t *map() { return 0; }
 };
 
 struct StdioFile : File_impl {
@@ -197,6 +205,146 @@ struct AssetFile: File_impl {
 };
 #endif
 
+// mappings handed out by File::map(), released with File::unmap()
+static const int kMaxMappings = 32;
+static struct {
+	uint8_t *ptr;
+	uint32_t size;
+	bool resident; // File::mapResident(), shared by the files inside
+} _mappings[kMaxMappings];
+static SDL_SpinLock _mappingsLock;
+
+static bool addMapping(uint8_t *ptr, uint32_t size, bool resident) {
+	SDL_AtomicLock(&_mappingsLock);
+	for (int i = 0; i < kMaxMappings; ++i) {
+		if (!_mappings[i].ptr) {
+			_mappings[i].ptr = ptr;
+			_mappings[i].size = size;
+			_mappings[i].resident = resident;
+			SDL_AtomicUnlock(&_mappingsLock);
+			return true;
+		}
+	}
+	SDL_AtomicUnlock(&_mappingsLock);
+	warning("No free slot for mapping %d bytes", size);
+	return false;
+}
+
+static void releaseMapping(uint8_t *ptr, uint32_t size) {
+#ifndef _WIN32
+	munmap(ptr, size);
+#else
+	// the resident files are read to memory
+	free(ptr);
+#endif
+}
+
+#ifndef _WIN32
+struct MappedFile : File_impl {
+	uint8_t *_ptr;
+	uint32_t _size, _offset;
+	MappedFile() : _ptr(0), _size(0), _offset(0) {}
+	bool open(const char *path, const char *mode) {
+		_ioErr = false;
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return false;
+		}
+		_size = st.st_size;
+		_offset = 0;
+		if (_size != 0) {
+			// private writable pages, in place patches of the data (eg. cutscene opcodes) are copy-on-write
+			void *ptr = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				::close(fd);
+				return false;
+			}
+			_ptr = (uint8_t *)ptr;
+		}
+		::close(fd);
+		return true;
+	}
+	void close() {
+		if (_ptr) {
+			munmap(_ptr, _size);
+			_ptr = 0;
+		}
+	}
+	uint32_t size() {
+		return _size;
+	}
+	void seek(int32_t off) {
+		_offset = off;
+	}
+	uint32_t read(void *ptr, uint32_t len) {
+		uint32_t count = len;
+		if (_offset + count > _size) {
+			count = (_offset < _size) ? _size - _offset : 0;
+			_ioErr = true;
+		}
+		if (count != 0) {
+			memcpy(ptr, _ptr + _offset, count);
+			_offset += count;
+		}
+		return count;
+	}
+	uint32_t write(const void *ptr, uint32_t len) {
+		_ioErr = true;
+		return 0;
+	}
+	uint8_t *map() {
+		if (!_ptr || !addMapping(_ptr, _size, false)) {
+			return 0;
+		}
+		uint8_t *ptr = _ptr;
+		_ptr = 0;
+		return ptr;
+	}
+};
+#endif
+
+// an entry of the data pack, File::map() returns a pointer inside the resident pack mapping
+struct PackEntryFile : File_impl {
+	uint8_t *_data;
+	uint32_t _size, _offset;
+	PackEntryFile(uint8_t *data, uint32_t size) : _data(data), _size(size), _offset(0) {}
+	bool open(const char *path, const char *mode) {
+		return false;
+	}
+	void close() {
+	}
+	uint32_t size() {
+		return _size;
+	}
+	void seek(int32_t off) {
+		_offset = off;
+	}
+	uint32_t read(void *ptr, uint32_t len) {
+		uint32_t count = len;
+		if (_offset + count > _size) {
+			count = (_offset < _size) ? _size - _offset : 0;
+			_ioErr = true;
+		}
+		if (count != 0) {
+			memcpy(ptr, _data + _offset, count);
+			_offset += count;
+		}
+		return count;
+	}
+	uint32_t write(const void *ptr, uint32_t len) {
+		_ioErr = true;
+		return 0;
+	}
+	uint8_t *map() {
+		return _data;
+	}
+};
+
 struct MemoryBufferFile: File_impl {
 	uint8_t *_ptr;
 	uint32_t _capacity, _offset, _len;
@@ -267,7 +415,22 @@ bool File::open(const char *filename, const char *mode, FileSystem *fs) {
 		_impl = 0;
 	}
 	assert(mode[0] != 'z');
-	_impl = new StdioFile;
+	uint8_t *data;
+	uint32_t dataSize;
+	if (fs->findPackEntry(filename, &data, &dataSize)) {
+		debug(DBG_FILE, "Open file name '%s' from pack, %d bytes", filename, dataSize);
+		_impl = new PackEntryFile(data, dataSize);
+		return true;
+	}
+	if (mode[0] == 'm') {
+#ifndef _WIN32
+		_impl = new MappedFile;
+#endif
+		++mode;
+	}
+	if (!_impl) {
+		_impl = new StdioFile;
+	}
 	char *path = fs->findPath(filename);
 	if (path) {
 		debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
@@ -377,6 +540,88 @@ uint32_t File::readUint32BE() {
 	return (hi << 16) | lo;
 }
 
+uint8_t *File::map() {
+	return _impl->map();
+}
+
+bool File::unmap(void *ptr) {
+	if (ptr) {
+		SDL_AtomicLock(&_mappingsLock);
+		for (int i = 0; i < kMaxMappings; ++i) {
+			uint8_t *p = _mappings[i].ptr;
+			if (p && (uint8_t *)ptr >= p && (uint8_t *)ptr < p + _mappings[i].size) {
+				if (_mappings[i].resident) {
+					SDL_AtomicUnlock(&_mappingsLock);
+					return true;
+				}
+				const uint32_t size = _mappings[i].size;
+				_mappings[i].ptr = 0;
+				SDL_AtomicUnlock(&_mappingsLock);
+				releaseMapping(p, size);
+				return true;
+			}
+		}
+		SDL_AtomicUnlock(&_mappingsLock);
+	}
+	return false;
+}
+
+uint8_t *File::mapResident(const char *path, uint32_t *size) {
+	uint8_t *p = 0;
+#ifndef _WIN32
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size != 0) {
+		*size = st.st_size;
+		// private writable pages, as MappedFile
+		void *ptr = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (ptr != MAP_FAILED) {
+			p = (uint8_t *)ptr;
+		}
+	}
+	::close(fd);
+#else
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	const long len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (len > 0) {
+		*size = len;
+		p = (uint8_t *)malloc(len);
+		if (p && fread(p, 1, len, fp) != (size_t)len) {
+			free(p);
+			p = 0;
+		}
+	}
+	fclose(fp);
+#endif
+	if (p && !addMapping(p, *size, true)) {
+		releaseMapping(p, *size);
+		p = 0;
+	}
+	return p;
+}
+
+void File::unmapResident(uint8_t *ptr) {
+	SDL_AtomicLock(&_mappingsLock);
+	for (int i = 0; i < kMaxMappings; ++i) {
+		if (_mappings[i].ptr == ptr && _mappings[i].resident) {
+			const uint32_t size = _mappings[i].size;
+			_mappings[i].ptr = 0;
+			SDL_AtomicUnlock(&_mappingsLock);
+			releaseMapping(ptr, size);
+			return;
+		}
+	}
+	SDL_AtomicUnlock(&_mappingsLock);
+}
+
 uint32_t File::write(const void *ptr, uint32_t len) {
 	return _impl->write(ptr, len);
 }
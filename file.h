@@ -26,6 +26,13 @@ struct File {
 	uint32_t size();
 	void seek(int32_t off);
 	uint32_t read(void *ptr, uint32_t len);
+	// zero copy access to the file opened with the 'm' mode, the caller owns the returned pointer (0 if not mapped)
+	uint8_t *map();
+	// releases a pointer inside a buffer returned by map(), false if the pointer is not mapped
+	static bool unmap(void *ptr);
+	// whole file kept in memory (eg. the data pack), unmap() ignores the pointers inside it
+	static uint8_t *mapResident(const char *path, uint32_t *size);
+	static void unmapResident(uint8_t *ptr);
 	uint8_t readByte();
 	uint16_t readUint16LE();
 	uint32_t readUint32LE();
@@ -0,0 +1,64 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <math.h>
+#include "frame_pacer.h"
+#include "systemstub.h"
+#include "util.h"
+
+FramePacer::FramePacer(SystemStub *stub)
+	: _stub(stub) {
+	_deadline = 0;
+	_deadlineFrac = 0;
+	_framesCount = 0;
+	_lateCount = 0;
+	_jitterSum = _jitterSqSum = 0;
+	_jitterMin = _jitterMax = 0;
+}
+
+void FramePacer::reset() {
+	_deadline = _stub->getTimeStampUs();
+	_deadlineFrac = 0;
+}
+
+// the period is periodNum/periodDen microseconds, the remainder is carried over so the rate does not drift
+void FramePacer::wait(uint32_t periodNum, uint32_t periodDen) {
+	_deadline += periodNum / periodDen;
+	_deadlineFrac += periodNum % periodDen;
+	if (_deadlineFrac >= periodDen) {
+		_deadlineFrac -= periodDen;
+		++_deadline;
+	}
+	const uint64_t now = _stub->getTimeStampUs();
+	if (now >= _deadline) {
+		if (now - _deadline > periodNum / periodDen) {
+			// more than a frame late (level loading, window dragged...), restart from now instead of catching up
+			++_lateCount;
+			_deadline = now;
+			_deadlineFrac = 0;
+		}
+		return;
+	}
+	_stub->waitUntil(_deadline);
+	const int32_t jitter = (int32_t)(_stub->getTimeStampUs() - _deadline);
+	if (_framesCount == 0) {
+		_jitterMin = _jitterMax = jitter;
+	} else {
+		_jitterMin = MIN(_jitterMin, jitter);
+		_jitterMax = MAX(_jitterMax, jitter);
+	}
+	_jitterSum += jitter;
+	_jitterSqSum += (int64_t)jitter * jitter;
+	++_framesCount;
+}
+
+void FramePacer::dumpStats(const char *name) const {
+	if (_framesCount == 0) {
+		return;
+	}
+	const double avg = _jitterSum / (double)_framesCount;
+	const double var = _jitterSqSum / (double)_framesCount - avg * avg;
+	debug(DBG_INFO, "%s pacing: %d frames, jitter avg %.1f us stddev %.1f us min %d us max %d us, %d late", name, _framesCount, avg, sqrt(var > 0. ? var : 0.), _jitterMin, _jitterMax, _lateCount);
+}
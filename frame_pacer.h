@@ -0,0 +1,32 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef FRAME_PACER_H__
+#define FRAME_PACER_H__
+
+#include "intern.h"
+
+struct SystemStub;
+
+struct FramePacer {
+	SystemStub *_stub;
+	uint64_t _deadline; // microseconds
+	uint32_t _deadlineFrac;
+	uint32_t _framesCount;
+	uint32_t _lateCount;
+	int64_t _jitterSum;
+	int64_t _jitterSqSum;
+	int32_t _jitterMin, _jitterMax;
+
+	FramePacer(SystemStub *stub);
+
+	void reset();
+	void wait(uint32_t periodNum, uint32_t periodDen);
+	void waitMs(uint32_t period) { wait(period * 1000, 1); }
+	void waitHz(uint32_t hz) { wait(1000000, hz); }
+	void dumpStats(const char *name) const;
+};
+
+#endif // FRAME_PACER_H__
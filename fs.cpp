@@ -15,12 +15,35 @@
 #ifdef USE_RWOPS
 #include <SDL_rwops.h>
 #endif
+#include <ctype.h>
+#include "file.h"
 #include "fs.h"
 #include "util.h"
 
+// single file archive of the data directory, big endian
+//   header : 'FBPK', version, entries count
+//   entries : name hash, data offset, data size, modification time, name offset (sorted by hash)
+//   names (zero terminated) and data (16 bytes aligned)
+static const uint32_t kPackTag = 0x4642504B; // 'FBPK'
+static const uint32_t kPackVersion = 1;
+static const int kPackHeaderSize = 12;
+static const int kPackEntrySize = 20;
+
+// FNV-1a, case insensitive as the file names lookups
+static uint32_t hashFileName(const char *name) {
+	uint32_t hash = 2166136261U;
+	for (; *name; ++name) {
+		hash ^= toupper((uint8_t)*name);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
 struct FileName {
 	char *name;
 	int dir;
+	uint32_t size;
+	uint32_t mtime;
 };
 
 struct FileSystem_impl {
@@ -29,9 +52,12 @@ struct FileSystem_impl {
 	int _dirsCount;
 	FileName *_filesList;
 	int _filesCount;
+	uint8_t *_pack;
+	uint32_t _packSize;
+	int _packCount;
 
 	FileSystem_impl() :
-		_dirsList(0), _dirsCount(0), _filesList(0), _filesCount(0) {
+		_dirsList(0), _dirsCount(0), _filesList(0), _filesCount(0), _pack(0), _packSize(0), _packCount(0) {
 	}
 
 	~FileSystem_impl() {
@@ -43,14 +69,85 @@ struct FileSystem_impl {
 			free(_filesList[i].name);
 		}
 		free(_filesList);
+		if (_pack) {
+			File::unmapResident(_pack);
+		}
 	}
 
 	void setRootDirectory(const char *dir) {
+		if (openPack(dir)) {
+			debug(DBG_FILE, "Found %d files in pack '%s'", _packCount, dir);
+			return;
+		}
 		getPathListFromDirectory(dir);
 		debug(DBG_FILE, "Found %d files and %d directories", _filesCount, _dirsCount);
 	}
 
+	bool openPack(const char *path) {
+		uint32_t size;
+		uint8_t *p = File::mapResident(path, &size);
+		if (!p) {
+			return false;
+		}
+		if (size < kPackHeaderSize || READ_BE_UINT32(p) != kPackTag) {
+			File::unmapResident(p);
+			return false;
+		}
+		const uint32_t version = READ_BE_UINT32(p + 4);
+		const uint32_t count = READ_BE_UINT32(p + 8);
+		if (version != kPackVersion) {
+			error("Unsupported data pack '%s' version %d", path, version);
+		}
+		if (count > (size - kPackHeaderSize) / kPackEntrySize) {
+			error("Corrupted data pack '%s', %d entries", path, count);
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint8_t *entry = p + kPackHeaderSize + i * kPackEntrySize;
+			const uint32_t offset = READ_BE_UINT32(entry + 4);
+			const uint32_t len = READ_BE_UINT32(entry + 8);
+			const uint32_t nameOffset = READ_BE_UINT32(entry + 16);
+			if (offset > size || len > size - offset || nameOffset >= size || !memchr(p + nameOffset, 0, size - nameOffset)) {
+				error("Corrupted data pack '%s' entry %d", path, i);
+			}
+		}
+		_pack = p;
+		_packSize = size;
+		_packCount = count;
+		return true;
+	}
+
+	const uint8_t *getPackEntry(int i) const {
+		return _pack + kPackHeaderSize + i * kPackEntrySize;
+	}
+
+	const char *getPackEntryName(int i) const {
+		return (const char *)_pack + READ_BE_UINT32(getPackEntry(i) + 16);
+	}
+
+	int findPackIndex(const char *name) const {
+		const uint32_t hash = hashFileName(name);
+		int lo = 0;
+		int hi = _packCount;
+		while (lo < hi) {
+			const int mid = (lo + hi) / 2;
+			if (READ_BE_UINT32(getPackEntry(mid)) < hash) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		for (; lo < _packCount && READ_BE_UINT32(getPackEntry(lo)) == hash; ++lo) {
+			if (strcasecmp(getPackEntryName(lo), name) == 0) {
+				return lo;
+			}
+		}
+		return -1;
+	}
+
 	int findPathIndex(const char *name) const {
+		if (_pack) {
+			return findPackIndex(name);
+		}
 		for (int i = 0; i < _filesCount; ++i) {
 			if (strcasecmp(_filesList[i].name, name) == 0) {
 				return i;
@@ -60,6 +157,9 @@ struct FileSystem_impl {
 	}
 
 	char *getPath(const char *name) const {
+		if (_pack) {
+			return 0;
+		}
 		const int i = findPathIndex(name);
 		if (i >= 0) {
 			const char *dir = _dirsList[_filesList[i].dir];
@@ -73,7 +173,7 @@ struct FileSystem_impl {
 		return 0;
 	}
 
-	void addPath(const char *dir, const char *name) {
+	void addPath(const char *dir, const char *name, uint32_t size, uint32_t mtime) {
 		int index = -1;
 		for (int i = 0; i < _dirsCount; ++i) {
 			if (strcmp(_dirsList[i], dir) == 0) {
@@ -93,6 +193,8 @@ struct FileSystem_impl {
 		if (_filesList) {
 			_filesList[_filesCount].name = strdup(name);
 			_filesList[_filesCount].dir = index;
+			_filesList[_filesCount].size = size;
+			_filesList[_filesCount].mtime = mtime;
 			++_filesCount;
 		}
 	}
@@ -116,7 +218,7 @@ void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
 				getPathListFromDirectory(filePath);
 			} else {
-				addPath(dir, findData.cFileName);
+				addPath(dir, findData.cFileName, findData.nFileSizeLow, findData.ftLastWriteTime.dwLowDateTime ^ findData.ftLastWriteTime.dwHighDateTime);
 			}
 		} while (FindNextFile(h, &findData));
 		FindClose(h);
@@ -138,7 +240,7 @@ void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 				if (S_ISDIR(st.st_mode)) {
 					getPathListFromDirectory(filePath);
 				} else {
-					addPath(dir, de->d_name);
+					addPath(dir, de->d_name, st.st_size, st.st_mtime);
 				}
 			}
 		}
@@ -160,6 +262,155 @@ char *FileSystem::findPath(const char *filename) const {
 	return _impl->getPath(filename);
 }
 
+int FileSystem::getFilesCount() const {
+	if (_impl->_pack) {
+		return _impl->_packCount;
+	}
+	return _impl->_filesCount;
+}
+
+const char *FileSystem::getFileName(int num) const {
+	assert(num >= 0 && num < getFilesCount());
+	if (_impl->_pack) {
+		return _impl->getPackEntryName(num);
+	}
+	return _impl->_filesList[num].name;
+}
+
+bool FileSystem::getFileInfo(const char *filename, uint32_t *size, uint32_t *mtime) const {
+	const int i = _impl->findPathIndex(filename);
+	if (i < 0) {
+		return false;
+	}
+	if (_impl->_pack) {
+		const uint8_t *entry = _impl->getPackEntry(i);
+		*size = READ_BE_UINT32(entry + 8);
+		*mtime = READ_BE_UINT32(entry + 12);
+		return true;
+	}
+	*size = _impl->_filesList[i].size;
+	*mtime = _impl->_filesList[i].mtime;
+	return true;
+}
+
+bool FileSystem::findPackEntry(const char *filename, uint8_t **data, uint32_t *size) const {
+	if (!_impl->_pack) {
+		return false;
+	}
+	const int i = _impl->findPackIndex(filename);
+	if (i < 0) {
+		return false;
+	}
+	const uint8_t *entry = _impl->getPackEntry(i);
+	*data = _impl->_pack + READ_BE_UINT32(entry + 4);
+	*size = READ_BE_UINT32(entry + 8);
+	return true;
+}
+
+struct PackFile {
+	uint32_t hash;
+	const char *name;
+	uint32_t size, mtime;
+};
+
+static int comparePackFiles(const void *a, const void *b) {
+	const PackFile *f1 = (const PackFile *)a;
+	const PackFile *f2 = (const PackFile *)b;
+	if (f1->hash != f2->hash) {
+		return (f1->hash < f2->hash) ? -1 : 1;
+	}
+	return strcasecmp(f1->name, f2->name);
+}
+
+static void writePackUint32(FILE *fp, uint32_t n) {
+	uint8_t buf[4];
+	buf[0] = n >> 24;
+	buf[1] = n >> 16;
+	buf[2] = n >> 8;
+	buf[3] = n;
+	fwrite(buf, 1, 4, fp);
+}
+
+static uint32_t alignPackOffset(uint32_t offset) {
+	return (offset + 15) & ~15;
+}
+
+bool FileSystem::createPack(const char *path) {
+	const int filesCount = getFilesCount();
+	PackFile *files = (PackFile *)malloc(filesCount * sizeof(PackFile));
+	if (!files) {
+		error("Unable to allocate %d pack entries", filesCount);
+	}
+	int count = 0;
+	for (int i = 0; i < filesCount; ++i) {
+		const char *name = getFileName(i);
+		// the same file name in two directories, the lookups return the first one
+		if (_impl->findPathIndex(name) != i) {
+			warning("Duplicate file '%s', ignoring", name);
+			continue;
+		}
+		PackFile *f = &files[count++];
+		f->hash = hashFileName(name);
+		f->name = name;
+		getFileInfo(name, &f->size, &f->mtime);
+	}
+	qsort(files, count, sizeof(PackFile), comparePackFiles);
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		free(files);
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	writePackUint32(fp, kPackTag);
+	writePackUint32(fp, kPackVersion);
+	writePackUint32(fp, count);
+	uint32_t namesSize = 0;
+	for (int i = 0; i < count; ++i) {
+		namesSize += strlen(files[i].name) + 1;
+	}
+	uint32_t nameOffset = kPackHeaderSize + count * kPackEntrySize;
+	uint32_t dataOffset = alignPackOffset(nameOffset + namesSize);
+	for (int i = 0; i < count; ++i) {
+		writePackUint32(fp, files[i].hash);
+		writePackUint32(fp, dataOffset);
+		writePackUint32(fp, files[i].size);
+		writePackUint32(fp, files[i].mtime);
+		writePackUint32(fp, nameOffset);
+		nameOffset += strlen(files[i].name) + 1;
+		dataOffset = alignPackOffset(dataOffset + files[i].size);
+	}
+	for (int i = 0; i < count; ++i) {
+		fwrite(files[i].name, 1, strlen(files[i].name) + 1, fp);
+	}
+	bool ret = true;
+	static const uint8_t padding[16] = { 0 };
+	for (int i = 0; i < count && ret; ++i) {
+		fwrite(padding, 1, alignPackOffset(ftell(fp)) - ftell(fp), fp);
+		File f;
+		if (!f.open(files[i].name, "rb", this)) {
+			warning("Unable to open '%s'", files[i].name);
+			ret = false;
+			break;
+		}
+		uint8_t buf[4096];
+		for (uint32_t len = files[i].size; len != 0; ) {
+			const uint32_t sz = MIN(len, (uint32_t)sizeof(buf));
+			if (f.read(buf, sz) != sz || fwrite(buf, 1, sz, fp) != sz) {
+				warning("I/O error when packing '%s'", files[i].name);
+				ret = false;
+				break;
+			}
+			len -= sz;
+		}
+	}
+	if (ret) {
+		debug(DBG_INFO, "Packed %d files to '%s', %d KB", count, path, (int)(ftell(fp) / 1024));
+	}
+	fclose(fp);
+	free(files);
+	return ret;
+}
+
 bool FileSystem::exists(const char *filename) const {
 	if (_impl->findPathIndex(filename) >= 0) {
 		return true;
@@ -19,6 +19,13 @@ struct FileSystem {
 
 	char *findPath(const char *filename) const;
 	bool exists(const char *filename) const;
+	int getFilesCount() const;
+	const char *getFileName(int num) const;
+	// size and modification time when the data directory was listed
+	bool getFileInfo(const char *filename, uint32_t *size, uint32_t *mtime) const;
+	// data of a file when the data path is a pack, valid for the lifetime of the FileSystem
+	bool findPackEntry(const char *filename, uint8_t **data, uint32_t *size) const;
+	bool createPack(const char *path);
 };
 
 #endif // FS_H__
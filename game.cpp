@@ -8,13 +8,14 @@
 #include "file.h"
 #include "fs.h"
 #include "game.h"
+#include "profiler.h"
 #include "systemstub.h"
 #include "util.h"
 
 Game::Game(SystemStub *stub, FileSystem *fs, const char *savePath, int level, ResourceType ver, Language lang, bool autoSave)
 	: _cut(&_res, stub, &_vid), _menu(&_res, stub, &_vid),
 	_mix(fs, stub), _res(fs, ver, lang), _vid(&_res, stub),
-	_stub(stub), _fs(fs), _savePath(savePath) {
+	_stub(stub), _fs(fs), _savePath(savePath), _pacer(stub) {
 	_stateSlot = 1;
 	_inp_demPos = 0;
 	_skillLevel = _menu._skill = kSkillNormal;
@@ -23,10 +24,16 @@ Game::Game(SystemStub *stub, FileSystem *fs, const char *savePath, int level, Re
 	_autoSave = autoSave;
 	_rewindPtr = -1;
 	_rewindLen = 0;
+	_nextRes = 0;
+	_nextResLevel = -1;
+	_nextResThread = 0;
+	if (g_options.cache_unpacked_data) {
+		_res._cachePath = savePath;
+	}
 }
 
 void Game::run() {
-	_randSeed = time(0);
+	_randSeed = g_options.fixed_random_seed ? 0 : time(0);
 
 	_res.init();
 	_res.load_TEXT();
@@ -72,6 +79,7 @@ void Game::run() {
 		_res.load("PERSO", Resource::OT_SPR);
 		_res.load_SPR_OFF("PERSO", _res._spr1);
 		_res.load_FIB("GLOBAL");
+		_res.resampleSfx(_mix.getSampleRate());
 		break;
 	}
 
@@ -139,6 +147,7 @@ void Game::run() {
 			_endLoop = false;
 			_frameTimestamp = _stub->getTimeStamp();
 			_saveTimestamp = _frameTimestamp;
+			_pacer.reset();
 			while (!_stub->_pi.quit && !_endLoop) {
 				mainLoop();
 				if (_demoBin != -1 && _inp_demPos >= _res._demLen) {
@@ -156,6 +165,13 @@ void Game::run() {
 		}
 	}
 
+	_pacer.dumpStats("Game");
+	_vid.dumpRoomCacheStats();
+	_res.dumpBankDataStats();
+	_cut._pacer.dumpStats("Cutscene");
+	PROFILE_DUMP();
+
+	stopLevelPrefetch();
 	_res.free_TEXT();
 	_mix.free();
 	_res.fini();
@@ -284,16 +300,28 @@ void Game::mainLoop() {
 		}
 	}
 	memcpy(_vid._frontLayer, _vid._backLayer, _vid._layerSize);
-	pge_getInput();
-	pge_prepare();
-	col_prepareRoomState();
+	{
+		PROFILE_SCOPE(kProfilerGetInput);
+		pge_getInput();
+	}
+	{
+		PROFILE_SCOPE(kProfilerPrepare);
+		pge_prepare();
+	}
+	{
+		PROFILE_SCOPE(kProfilerPrepareRoomState);
+		col_prepareRoomState();
+	}
 	uint8_t oldLevel = _currentLevel;
-	for (uint16_t i = 0; i < _res._pgeNum; ++i) {
-		LivePGE *pge = _pge_liveTable2[i];
-		if (pge) {
-			_col_currentPiegeGridPosY = (pge->pos_y / 36) & ~1;
-			_col_currentPiegeGridPosX = (pge->pos_x + 8) >> 4;
-			pge_process(pge);
+	{
+		PROFILE_SCOPE(kProfilerProcess);
+		for (uint16_t i = 0; i < _res._pgeNum; ++i) {
+			LivePGE *pge = _pge_liveTable2[i];
+			if (pge) {
+				_col_currentPiegeGridPosY = (pge->pos_y / 36) & ~1;
+				_col_currentPiegeGridPosX = (pge->pos_x + 8) >> 4;
+				pge_process(pge);
+			}
 		}
 	}
 	if (oldLevel != _currentLevel) {
@@ -310,13 +338,19 @@ void Game::mainLoop() {
 			_deathCutsceneCounter = 1;
 		} else {
 			_currentRoom = _pgeLive[0].room_location;
-			loadLevelMap();
+			{
+				PROFILE_SCOPE(kProfilerLoadLevelMap);
+				loadLevelMap();
+			}
 			_loadMap = false;
 			_vid.fullRefresh();
 		}
 	}
-	prepareAnims();
-	drawAnims();
+	{
+		PROFILE_SCOPE(kProfilerAnims);
+		prepareAnims();
+		drawAnims();
+	}
 	drawCurrentInventoryItem();
 	drawLevelTexts();
 	if (g_options.enable_password_menu) {
@@ -325,8 +359,15 @@ void Game::mainLoop() {
 	if (_blinkingConradCounter != 0) {
 		--_blinkingConradCounter;
 	}
-	_vid.updateScreen();
-	updateTiming();
+	_res.endBankDataFrame();
+	{
+		PROFILE_SCOPE(kProfilerUpdateScreen);
+		_vid.updateScreen();
+	}
+	{
+		PROFILE_SCOPE(kProfilerUpdateTiming);
+		updateTiming();
+	}
 	drawStoryTexts();
 	if (_stub->_pi.backspace) {
 		_stub->_pi.backspace = false;
@@ -351,11 +392,10 @@ void Game::mainLoop() {
 
 void Game::updateTiming() {
 	static const int frameHz = 30;
-	int32_t delay = _stub->getTimeStamp() - _frameTimestamp;
-	int32_t pause = (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) ? 20 : (1000 / frameHz);
-	pause -= delay;
-	if (pause > 0) {
-		_stub->sleep(pause);
+	if (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) {
+		_pacer.waitMs(20);
+	} else {
+		_pacer.waitHz(frameHz);
 	}
 	_frameTimestamp = _stub->getTimeStamp();
 }
@@ -412,6 +452,10 @@ void Game::inp_handleSpecialKeys() {
 		}
 		_stub->_pi.rewind = false;
 	}
+	if (_stub->_pi.dumpStats) {
+		PROFILE_DUMP();
+		_stub->_pi.dumpStats = false;
+	}
 }
 
 void Game::drawCurrentInventoryItem() {
@@ -1231,118 +1275,163 @@ bool Game::hasLevelMap(int level, int room) const {
 	return false;
 }
 
+// the rooms of the Amiga level 2 are split in several .LEV files, 0 if the room is in all of them
+static int AMIGA_getLevel2FileNum(int room) {
+	switch (room) {
+	case 14:
+	case 19:
+	case 52:
+	case 53:
+		return 1;
+	case 11:
+	case 24:
+	case 27:
+	case 56:
+		return 2;
+	}
+	return 0;
+}
+
 void Game::loadLevelMap() {
 	debug(DBG_GAME, "Game::loadLevelMap() room=%d", _currentRoom);
 	_currentIcon = 0xFF;
-	switch (_res._type) {
-	case kResourceTypeAmiga:
-		if (_currentLevel == 1) {
-			int num = 0;
-			switch (_currentRoom) {
-			case 14:
-			case 19:
-			case 52:
-			case 53:
-				num = 1;
-				break;
-			case 11:
-			case 24:
-			case 27:
-			case 56:
-				num = 2;
-				break;
-			}
-			if (num != 0 && _res._levNum != num) {
-				char name[9];
-				snprintf(name, sizeof(name), "level2_%d", num);
-				_res.load(name, Resource::OT_LEV);
-				_res._levNum = num;
-			}
-		}
-		_vid.AMIGA_decodeLev(_currentLevel, _currentRoom);
-		break;
-	case kResourceTypeDOS:
-		_vid.PC_decodeMap(_currentLevel, _currentRoom);
-		break;
+	// hasLevelMap() checks the next rooms against the loaded file, it must be switched even for a cached room
+	if (_res._type == kResourceTypeAmiga && _currentLevel == 1) {
+		const int num = AMIGA_getLevel2FileNum(_currentRoom);
+		if (num != 0 && _res._levNum != num) {
+			char name[9];
+			snprintf(name, sizeof(name), "level2_%d", num);
+			_res.load(name, Resource::OT_LEV);
+			_res._levNum = num;
+		}
+	}
+	if (_vid.loadRoomFromCache(_currentLevel, _currentRoom)) {
+		memcpy(_vid._backLayer, _vid._frontLayer, _vid._layerSize);
+		_vid.setLevelPalettes(_currentLevel);
+		return;
+	}
+	if (_vid.decodeRoom(_currentLevel, _currentRoom)) {
+		_vid.storeRoomInCache(_currentLevel, _currentRoom);
+		memcpy(_vid._backLayer, _vid._frontLayer, _vid._layerSize);
+		_vid.setLevelPalettes(_currentLevel);
 	}
 }
 
-void Game::loadLevelData() {
-	_res.clearLevelRes();
-	const Level *lvl = &_gameLevels[_currentLevel];
-	switch (_res._type) {
+void Game::loadLevelRes(Resource *res, int level) {
+	res->clearLevelRes();
+	const Level *lvl = &_gameLevels[level];
+	switch (res->_type) {
 	case kResourceTypeAmiga:
-		if (_res._isDemo) {
+		if (res->_isDemo) {
 			static const char *fname1 = "demo";
 			static const char *fname2 = "demof";
-			_res.load(fname1, Resource::OT_MBK);
-			_res.load(fname1, Resource::OT_CT);
-			_res.load(fname1, Resource::OT_PAL);
-			_res.load(fname1, Resource::OT_RPC);
-			_res.load(fname1, Resource::OT_SPC);
-			_res.load(fname1, Resource::OT_LEV);
-			_res.load(fname2, Resource::OT_PGE);
-			_res.load(fname1, Resource::OT_OBJ);
-			_res.load(fname1, Resource::OT_ANI);
-			_res.load(fname2, Resource::OT_TBN);
-			_res.load_SPL_demo();
-			_res.load("level1", Resource::OT_SGD);
+			res->load(fname1, Resource::OT_MBK);
+			res->load(fname1, Resource::OT_CT);
+			res->load(fname1, Resource::OT_PAL);
+			res->load(fname1, Resource::OT_RPC);
+			res->load(fname1, Resource::OT_SPC);
+			res->load(fname1, Resource::OT_LEV);
+			res->load(fname2, Resource::OT_PGE);
+			res->load(fname1, Resource::OT_OBJ);
+			res->load(fname1, Resource::OT_ANI);
+			res->load(fname2, Resource::OT_TBN);
+			res->load("level1", Resource::OT_SGD);
 			break;
 		}
 		{
 			const char *name = lvl->nameAmiga;
-			if (_currentLevel == 4) {
+			if (level == 4) {
 				name = _gameLevels[3].nameAmiga;
 			}
-			_res.load(name, Resource::OT_MBK);
-			if (_currentLevel == 6) {
-				_res.load(_gameLevels[5].nameAmiga, Resource::OT_CT);
+			res->load(name, Resource::OT_MBK);
+			if (level == 6) {
+				res->load(_gameLevels[5].nameAmiga, Resource::OT_CT);
 			} else {
-				_res.load(name, Resource::OT_CT);
+				res->load(name, Resource::OT_CT);
 			}
-			_res.load(name, Resource::OT_PAL);
-			_res.load(name, Resource::OT_RPC);
-			_res.load(name, Resource::OT_SPC);
-			if (_currentLevel == 1) {
-				_res.load("level2_1", Resource::OT_LEV);
-				_res._levNum = 1;
+			res->load(name, Resource::OT_PAL);
+			res->load(name, Resource::OT_RPC);
+			res->load(name, Resource::OT_SPC);
+			if (level == 1) {
+				res->load("level2_1", Resource::OT_LEV);
+				res->_levNum = 1;
 			} else {
-				_res.load(name, Resource::OT_LEV);
+				res->load(name, Resource::OT_LEV);
 			}
 		}
-		_res.load(lvl->nameAmiga, Resource::OT_PGE);
-		_res.load(lvl->nameAmiga, Resource::OT_OBC);
-		_res.load(lvl->nameAmiga, Resource::OT_ANI);
-		_res.load(lvl->nameAmiga, Resource::OT_TBN);
-		{
-			char name[8];
-			snprintf(name, sizeof(name), "level%d", lvl->sound);
-			_res.load(name, Resource::OT_SPL);
-		}
-		if (_currentLevel == 0) {
-			_res.load(lvl->nameAmiga, Resource::OT_SGD);
+		res->load(lvl->nameAmiga, Resource::OT_PGE);
+		res->load(lvl->nameAmiga, Resource::OT_OBC);
+		res->load(lvl->nameAmiga, Resource::OT_ANI);
+		res->load(lvl->nameAmiga, Resource::OT_TBN);
+		if (level == 0) {
+			res->load(lvl->nameAmiga, Resource::OT_SGD);
 		}
 		break;
 	case kResourceTypeDOS:
-		_res.load(lvl->name, Resource::OT_MBK);
-		_res.load(lvl->name, Resource::OT_CT);
-		_res.load(lvl->name, Resource::OT_PAL);
-		_res.load(lvl->name, Resource::OT_RP);
-		if (_res._isDemo || g_options.use_tile_data) { // use .BNQ/.LEV/(.SGD) instead of .MAP (PC demo)
-			if (_currentLevel == 0) {
-				_res.load(lvl->name, Resource::OT_SGD);
+		res->load(lvl->name, Resource::OT_MBK);
+		res->load(lvl->name, Resource::OT_CT);
+		res->load(lvl->name, Resource::OT_PAL);
+		res->load(lvl->name, Resource::OT_RP);
+		if (res->_isDemo || g_options.use_tile_data) { // use .BNQ/.LEV/(.SGD) instead of .MAP (PC demo)
+			if (level == 0) {
+				res->load(lvl->name, Resource::OT_SGD);
 			}
-			_res.load(lvl->name, Resource::OT_LEV);
-			_res.load(lvl->name, Resource::OT_BNQ);
+			res->load(lvl->name, Resource::OT_LEV);
+			res->load(lvl->name, Resource::OT_BNQ);
 		} else {
-			_res.load(lvl->name, Resource::OT_MAP);
+			res->load(lvl->name, Resource::OT_MAP);
 		}
-		_res.load(lvl->name2, Resource::OT_PGE);
-		_res.load(lvl->name2, Resource::OT_OBJ);
-		_res.load(lvl->name2, Resource::OT_ANI);
-		_res.load(lvl->name2, Resource::OT_TBN);
+		res->load(lvl->name2, Resource::OT_PGE);
+		res->load(lvl->name2, Resource::OT_OBJ);
+		res->load(lvl->name2, Resource::OT_ANI);
+		res->load(lvl->name2, Resource::OT_TBN);
 		break;
 	}
+}
+
+void Game::loadLevelData() {
+	const uint32_t rssKb = getResidentMemoryKb();
+	if (!takePrefetchedLevel(_currentLevel)) {
+		loadLevelRes(&_res, _currentLevel);
+	}
+	const Level *lvl = &_gameLevels[_currentLevel];
+	if (_res._type == kResourceTypeAmiga) {
+		if (_res._isDemo) {
+			_res.load_SPL_demo();
+		} else {
+			char name[8];
+			snprintf(name, sizeof(name), "level%d", lvl->sound);
+			// the previous samples are released
+			_mix.stopAll();
+			_res.load(name, Resource::OT_SPL);
+		}
+		_res.resampleSfx(_mix.getSampleRate());
+	}
+	if (g_options.predecode_banks) {
+		_res.predecodeBanks();
+	}
+	if (g_options.predecode_rooms) {
+		uint8_t rooms[0x40];
+		int count = 0;
+		for (int room = 0; room < 0x40; ++room) {
+			if (!hasLevelMap(_currentLevel, room)) {
+				continue;
+			}
+			if (_res._type == kResourceTypeAmiga && _currentLevel == 1) {
+				// the rooms of the other level2_N files are not predecoded, it would load each file here.
+				// they are decoded on the first visit, after loading their file, and kept in the rooms cache
+				const int num = AMIGA_getLevel2FileNum(room);
+				if (num != 0 && num != _res._levNum) {
+					continue;
+				}
+			}
+			rooms[count++] = room;
+		}
+		_vid.predecodeRooms(_currentLevel, rooms, count);
+	} else {
+		_vid.freeLevelRooms();
+	}
+	debug(DBG_INFO, "Level %d loaded, resident memory %d KB (%d KB before)", _currentLevel, getResidentMemoryKb(), rssKb);
 
 	_cut._id = lvl->cutscene_id;
 	if (_res._isDemo && _currentLevel == 5) { // PC demo does not include TELEPORT.*
@@ -1391,6 +1480,62 @@ void Game::loadLevelData() {
 	_validSaveState = false;
 
 	_mix.playMusic(Mixer::MUSIC_TRACK + lvl->track);
+
+	prefetchLevel(_currentLevel + 1);
+}
+
+static int prefetchThread(void *param) {
+	Game *g = (Game *)param;
+	g->loadLevelRes(g->_nextRes, g->_nextResLevel);
+	return 0;
+}
+
+// reads the files of the next level in the background while the current one is played
+void Game::prefetchLevel(int level) {
+	// level 7 is the ending, the demos only include some of the levels
+	if (!g_options.prefetch_next_level || level >= 7 || _res._isDemo) {
+		return;
+	}
+	if (_nextResThread) {
+		SDL_WaitThread(_nextResThread, 0);
+		_nextResThread = 0;
+	}
+	if (!_nextRes) {
+		_nextRes = new Resource(_fs, _res._type, _res._lang);
+		_nextRes->_cachePath = _res._cachePath;
+	}
+	_nextRes->_lang = _res._lang;
+	_nextResLevel = level;
+	_nextResThread = SDL_CreateThread(prefetchThread, "level_prefetch", this);
+	if (!_nextResThread) {
+		warning("Unable to create level prefetch thread");
+		_nextResLevel = -1;
+	}
+}
+
+bool Game::takePrefetchedLevel(int level) {
+	if (_nextResThread) {
+		SDL_WaitThread(_nextResThread, 0);
+		_nextResThread = 0;
+	}
+	if (_nextResLevel != level || _nextRes->_lang != _res._lang) {
+		return false;
+	}
+	debug(DBG_INFO, "Using prefetched data for level %d", level);
+	// the previous level data is released by the next prefetch
+	_res.swapLevelRes(_nextRes);
+	_nextResLevel = -1;
+	return true;
+}
+
+void Game::stopLevelPrefetch() {
+	if (_nextResThread) {
+		SDL_WaitThread(_nextResThread, 0);
+		_nextResThread = 0;
+	}
+	_nextResLevel = -1;
+	delete _nextRes;
+	_nextRes = 0;
 }
 
 void Game::drawIcon(uint8_t iconNum, int16_t x, int16_t y, uint8_t colMask) {
@@ -1441,7 +1586,11 @@ void Game::playSound(uint8_t num, uint8_t softVol) {
 		SoundFx *sfx = &_res._sfxList[num];
 		if (sfx->data) {
 			const int volume = Mixer::MAX_VOLUME >> (2 * softVol);
-			_mix.play(sfx->data, sfx->len, sfx->freq, volume);
+			if (sfx->pcm) {
+				_mix.playPcm(sfx->data, sfx->pcm, sfx->pcmLen, volume);
+			} else {
+				_mix.play(sfx->data, sfx->len, sfx->freq, volume);
+			}
 		}
 	} else if (num == 66) {
 		// open/close inventory (DOS)
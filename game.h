@@ -7,8 +7,10 @@
 #ifndef GAME_H__
 #define GAME_H__
 
+#include <SDL_thread.h>
 #include "intern.h"
 #include "cutscene.h"
+#include "frame_pacer.h"
 #include "menu.h"
 #include "mixer.h"
 #include "resource.h"
@@ -96,8 +98,12 @@ struct Game {
 	bool _saveStateCompleted;
 	bool _endLoop;
 	uint32_t _frameTimestamp;
+	FramePacer _pacer;
 	bool _autoSave;
 	uint32_t _saveTimestamp;
+	Resource *_nextRes;
+	int _nextResLevel;
+	SDL_Thread *_nextResThread;
 
 	Game(SystemStub *, FileSystem *, const char *savePath, int level, ResourceType ver, Language lang, bool autoSave);
 
@@ -109,7 +115,11 @@ struct Game {
 	void playCutscene(int id = -1);
 	bool hasLevelMap(int level, int room) const;
 	void loadLevelMap();
+	void loadLevelRes(Resource *res, int level);
 	void loadLevelData();
+	void prefetchLevel(int level);
+	bool takePrefetchedLevel(int level);
+	void stopLevelPrefetch();
 	void drawIcon(uint8_t iconNum, int16_t x, int16_t y, uint8_t colMask);
 	void drawCurrentInventoryItem();
 	void printLevelCode();
@@ -127,6 +127,20 @@ struct Options {
 	bool play_serrure_cutscene;
 	bool play_carte_cutscene;
 	bool play_gamesaved_sound;
+	bool use_palette_texture;
+	bool use_presenter_thread;
+	bool enable_vsync;
+	int audio_sample_rate;
+	int audio_buffer_size;
+	int audio_resampler;
+	int room_cache_size;
+	int bank_cache_size;
+	bool prerender_music;
+	bool fixed_random_seed;
+	bool prefetch_next_level;
+	bool predecode_rooms;
+	bool predecode_banks;
+	bool cache_unpacked_data;
 };
 
 struct Color {
@@ -253,7 +267,14 @@ struct CollisionSlot {
 
 struct BankSlot {
 	uint16_t entryNum;
-	uint8_t *ptr;
+	uint32_t offset, size; // 32 bytes units
+	uint32_t lastUse;
+};
+
+struct BankArena {
+	uint8_t *data;
+	uint32_t size;
+	int32_t offsets[256]; // by entry number, -1 if not unpacked
 };
 
 struct CollisionSlot2 {
@@ -275,6 +296,8 @@ struct SoundFx {
 	uint16_t freq;
 	uint8_t *data;
 	int8_t peak;
+	int16_t *pcm; // resampled to the output rate
+	uint32_t pcmLen;
 };
 
 extern Options g_options;
@@ -17,12 +17,18 @@
 static const char *USAGE =
 	"REminiscence - Flashback Interpreter\n"
 	"Usage: %s [OPTIONS]...\n"
-	"  --datapath=PATH   Path to data files (default 'DATA')\n"
+	"  --datapath=PATH   Path to data files or pack (default 'DATA')\n"
 	"  --savepath=PATH   Path to save files (default '.')\n"
 	"  --levelnum=NUM    Start to level, bypass introduction\n"
 	"  --windowed        Windowed (4x) display\n"
 	"  --language=LANG   Language (fr,en,de,sp,it,jp)\n"
 	"  --autosave        Save game state automatically\n"
+	"  --headless[=NUM]  No display and no throttling, quit after NUM frames\n"
+	"  --audiorate=HZ    Audio output sample rate (default 22050)\n"
+	"  --audiobuffer=NUM Audio buffer size in samples (default 2048)\n"
+	"  --render-audio=PATH  Headless, write the sound output to a .wav file\n"
+	"  --rebuild-cache   Unpack the compressed data files to the save path and exit\n"
+	"  --pack=PATH       Write the data files to a single pack file and exit\n"
 ;
 
 static int detectVersion(FileSystem *fs) {
@@ -92,6 +98,20 @@ static void initOptions() {
 	g_options.play_serrure_cutscene = false;
 	g_options.play_carte_cutscene = false;
 	g_options.play_gamesaved_sound = false;
+	g_options.use_palette_texture = false;
+	g_options.use_presenter_thread = false;
+	g_options.enable_vsync = false;
+	g_options.prerender_music = true;
+	g_options.fixed_random_seed = false;
+	g_options.prefetch_next_level = true;
+	g_options.predecode_rooms = false;
+	g_options.predecode_banks = false;
+	g_options.cache_unpacked_data = true;
+	g_options.audio_sample_rate = 22050;
+	g_options.audio_buffer_size = 2048;
+	g_options.audio_resampler = 1;
+	g_options.room_cache_size = 8;
+	g_options.bank_cache_size = 28;
 	// read configuration file
 	struct {
 		const char *name;
@@ -111,6 +131,26 @@ static void initOptions() {
 		{ "play_serrure_cutscene", &g_options.play_serrure_cutscene },
 		{ "play_carte_cutscene", &g_options.play_carte_cutscene },
 		{ "play_gamesaved_sound", &g_options.play_gamesaved_sound },
+		{ "use_palette_texture", &g_options.use_palette_texture },
+		{ "use_presenter_thread", &g_options.use_presenter_thread },
+		{ "enable_vsync", &g_options.enable_vsync },
+		{ "prerender_music", &g_options.prerender_music },
+		{ "fixed_random_seed", &g_options.fixed_random_seed },
+		{ "prefetch_next_level", &g_options.prefetch_next_level },
+		{ "predecode_rooms", &g_options.predecode_rooms },
+		{ "predecode_banks", &g_options.predecode_banks },
+		{ "cache_unpacked_data", &g_options.cache_unpacked_data },
+		{ 0, 0 }
+	};
+	struct {
+		const char *name;
+		int *value;
+	} intOpts[] = {
+		{ "audio_sample_rate", &g_options.audio_sample_rate },
+		{ "audio_buffer_size", &g_options.audio_buffer_size },
+		{ "audio_resampler", &g_options.audio_resampler },
+		{ "room_cache_size", &g_options.room_cache_size },
+		{ "bank_cache_size", &g_options.bank_cache_size },
 		{ 0, 0 }
 	};
 	static const char *filename = strcat(SDL_GetBasePath(), "rs.cfg");
@@ -137,6 +177,12 @@ static void initOptions() {
 							break;
 						}
 					}
+					for (int i = 0; !foundOption && intOpts[i].name; ++i) {
+						if (strncmp(buf, intOpts[i].name, strlen(intOpts[i].name)) == 0) {
+							*intOpts[i].value = atoi(p);
+							foundOption = true;
+						}
+					}
 					if (!foundOption) {
 						warning("Unhandled option '%s', ignoring", buf);
 					}
@@ -154,10 +200,17 @@ int main(int argc, char *argv[]) {
 	bool fullscreen = true;
 	bool autoSave = false;
 	int forcedLanguage = -1;
+	bool headless = false;
+	int headlessFrames = 0;
+	const char *renderAudioPath = 0;
+	int audioSampleRate = 0;
+	int audioBufferSize = 0;
+	bool rebuildCache = false;
+	const char *packPath = 0;
 	if (argc == 2) {
-		// data path as the only command line argument
+		// data path (or pack) as the only command line argument
 		struct stat st;
-		if (stat(argv[1], &st) == 0 && S_ISDIR(st.st_mode)) {
+		if (stat(argv[1], &st) == 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
 			dataPath = strdup(argv[1]);
 		}
 	}
@@ -169,6 +222,12 @@ int main(int argc, char *argv[]) {
 			{ "windowed",   no_argument,       0, 4 },
 			{ "language",   required_argument, 0, 5 },
 			{ "autosave",   no_argument,       0, 6 },
+			{ "headless",   optional_argument, 0, 7 },
+			{ "audiorate",  required_argument, 0, 8 },
+			{ "audiobuffer", required_argument, 0, 9 },
+			{ "render-audio", required_argument, 0, 10 },
+			{ "rebuild-cache", no_argument, 0, 11 },
+			{ "pack",       required_argument, 0, 12 },
 			{ 0, 0, 0, 0 }
 		};
 		int index;
@@ -213,21 +272,67 @@ int main(int argc, char *argv[]) {
 		case 6:
 			autoSave = true;
 			break;
+		case 7:
+			headless = true;
+			if (optarg) {
+				headlessFrames = atoi(optarg);
+			}
+			break;
+		case 8:
+			audioSampleRate = atoi(optarg);
+			break;
+		case 9:
+			audioBufferSize = atoi(optarg);
+			break;
+		case 10:
+			headless = true;
+			renderAudioPath = strdup(optarg);
+			break;
+		case 11:
+			rebuildCache = true;
+			break;
+		case 12:
+			packPath = strdup(optarg);
+			break;
 		default:
 			printf(USAGE, argv[0]);
 			return 0;
 		}
 	}
 	initOptions();
+	if (audioSampleRate > 0) {
+		g_options.audio_sample_rate = audioSampleRate;
+	}
+	if (audioBufferSize > 0) {
+		g_options.audio_buffer_size = audioBufferSize;
+	}
+	if (headless) {
+		// the samples are pulled as the game sleeps, rendering them in the callback keeps the output deterministic
+		g_options.prerender_music = false;
+		g_options.fixed_random_seed = true;
+	}
 	g_debugMask = DBG_INFO; // DBG_CUT | DBG_VIDEO | DBG_RES | DBG_MENU | DBG_PGE | DBG_GAME | DBG_UNPACK | DBG_COL | DBG_MOD | DBG_SFX | DBG_FILE;
 	FileSystem fs(dataPath);
+	if (packPath) {
+		return fs.createPack(packPath) ? 0 : -1;
+	}
 	const int version = detectVersion(&fs);
 	if (version == -1) {
 		error("Unable to find data files, check that all required files are present");
 		return -1;
 	}
 	const Language language = (forcedLanguage == -1) ? detectLanguage(&fs) : (Language)forcedLanguage;
-	SystemStub *stub = SystemStub_SDL_create();
+	if (rebuildCache) {
+		if (!savePath) {
+			error("No save path to write the cache files");
+		}
+		Resource res(&fs, (ResourceType)version, language);
+		res._cachePath = savePath;
+		res.init();
+		res.rebuildCache();
+		return 0;
+	}
+	SystemStub *stub = headless ? SystemStub_Null_create(headlessFrames, renderAudioPath) : SystemStub_SDL_create();
 	Game *g = new Game(stub, &fs, savePath, levelNum, (ResourceType)version, language, autoSave);
 	stub->init(g_caption, g->_vid._w, g->_vid._h, fullscreen);
 	g->run();
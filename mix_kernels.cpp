@@ -0,0 +1,146 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <SDL.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define MIX_KERNELS_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_KERNELS_NEON
+#endif
+#include "mix_kernels.h"
+#include "resampler.h"
+#include "util.h"
+
+#if defined(MIX_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_SSE2
+#endif
+
+typedef void (*AccumulateS16Proc)(int32_t *acc, const int16_t *src, int count, int gain);
+typedef void (*ClipS16Proc)(int16_t *dst, const int32_t *acc, int count);
+
+static void accumulateS16_C(int32_t *acc, const int16_t *src, int count, int gain) {
+	for (int i = 0; i < count; ++i) {
+		acc[i] += (src[i] * gain) >> 8;
+	}
+}
+
+static void clipS16_C(int16_t *dst, const int32_t *acc, int count) {
+	for (int i = 0; i < count; ++i) {
+		int sample = acc[i];
+		if (sample < -32768) {
+			sample = -32768;
+		} else if (sample > 32767) {
+			sample = 32767;
+		}
+		dst[i] = sample;
+	}
+}
+
+#ifdef MIX_KERNELS_X86
+// the gain fits in 16 bits, the low and high halves of the products are interleaved back to 32 bits
+TARGET_SSE2 static void accumulateS16_SSE2(int32_t *acc, const int16_t *src, int count, int gain) {
+	const __m128i g = _mm_set1_epi16(gain);
+	for (; count >= 8; count -= 8) {
+		const __m128i s16 = _mm_loadu_si128((const __m128i *)src);
+		const __m128i lo = _mm_mullo_epi16(s16, g);
+		const __m128i hi = _mm_mulhi_epi16(s16, g);
+		__m128i *p = (__m128i *)acc;
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8)));
+		_mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8)));
+		acc += 8;
+		src += 8;
+	}
+	accumulateS16_C(acc, src, count, gain);
+}
+
+TARGET_SSE2 static void clipS16_SSE2(int16_t *dst, const int32_t *acc, int count) {
+	for (; count >= 8; count -= 8) {
+		const __m128i a0 = _mm_loadu_si128((const __m128i *)acc);
+		const __m128i a1 = _mm_loadu_si128((const __m128i *)(acc + 4));
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(a0, a1));
+		acc += 8;
+		dst += 8;
+	}
+	clipS16_C(dst, acc, count);
+}
+#endif
+
+#ifdef MIX_KERNELS_NEON
+static void accumulateS16_NEON(int32_t *acc, const int16_t *src, int count, int gain) {
+	for (; count >= 8; count -= 8) {
+		const int16x8_t s16 = vld1q_s16(src);
+		vst1q_s32(acc, vsraq_n_s32(vld1q_s32(acc), vmull_n_s16(vget_low_s16(s16), gain), 8));
+		vst1q_s32(acc + 4, vsraq_n_s32(vld1q_s32(acc + 4), vmull_n_s16(vget_high_s16(s16), gain), 8));
+		acc += 8;
+		src += 8;
+	}
+	accumulateS16_C(acc, src, count, gain);
+}
+
+static void clipS16_NEON(int16_t *dst, const int32_t *acc, int count) {
+	for (; count >= 8; count -= 8) {
+		vst1q_s16(dst, vcombine_s16(vqmovn_s32(vld1q_s32(acc)), vqmovn_s32(vld1q_s32(acc + 4))));
+		acc += 8;
+		dst += 8;
+	}
+	clipS16_C(dst, acc, count);
+}
+#endif
+
+static AccumulateS16Proc _accumulateS16;
+static ClipS16Proc _clipS16;
+
+static void initMixKernels() {
+	const char *name = "C";
+	_accumulateS16 = accumulateS16_C;
+	_clipS16 = clipS16_C;
+#ifdef MIX_KERNELS_X86
+	if (SDL_HasSSE2()) {
+		name = "SSE2";
+		_accumulateS16 = accumulateS16_SSE2;
+		_clipS16 = clipS16_SSE2;
+	}
+#endif
+#ifdef MIX_KERNELS_NEON
+	if (SDL_HasNEON()) {
+		name = "NEON";
+		_accumulateS16 = accumulateS16_NEON;
+		_clipS16 = clipS16_NEON;
+	}
+#endif
+	debug(DBG_SND, "Using %s mixing kernels", name);
+}
+
+uint32_t mixS8(int32_t *acc, const uint8_t *data, uint32_t len, uint32_t pos, uint32_t inc, int count, int gain) {
+	assert(count <= kMixBlockSize);
+	int16_t buf[kMixBlockSize];
+	pos = resampleS8(buf, data, len, pos, inc, count);
+	mixS16(acc, buf, count, gain);
+	return pos;
+}
+
+void mixS16(int32_t *acc, const int16_t *src, int count, int gain) {
+	if (!_accumulateS16) {
+		initMixKernels();
+	}
+	_accumulateS16(acc, src, count, gain);
+}
+
+void mixLoadS16(int32_t *acc, const int16_t *src, int count) {
+	for (int i = 0; i < count; ++i) {
+		acc[i] = src[i];
+	}
+}
+
+void mixClipS16(int16_t *dst, const int32_t *acc, int count) {
+	if (!_clipS16) {
+		initMixKernels();
+	}
+	_clipS16(dst, acc, count);
+}
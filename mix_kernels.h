@@ -0,0 +1,28 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef MIX_KERNELS_H__
+#define MIX_KERNELS_H__
+
+#include "intern.h"
+
+enum {
+	kMixBlockSize = 512,
+	kMixUnityGain = 256
+};
+
+inline int mixGain(int volume, int maxVolume) {
+	return volume * kMixUnityGain / maxVolume;
+}
+
+// adds 'count' (up to kMixBlockSize) samples of the 8-bit 'data' buffer resampled from the fixed point position 'pos', returns the next position
+extern uint32_t mixS8(int32_t *acc, const uint8_t *data, uint32_t len, uint32_t pos, uint32_t inc, int count, int gain);
+// adds 'count' 16-bit samples at the output rate
+extern void mixS16(int32_t *acc, const int16_t *src, int count, int gain);
+extern void mixLoadS16(int32_t *acc, const int16_t *src, int count);
+// single saturation pass of the accumulated block
+extern void mixClipS16(int16_t *dst, const int32_t *acc, int count);
+
+#endif // MIX_KERNELS_H__
@@ -4,7 +4,9 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include "mix_kernels.h"
 #include "mixer.h"
+#include "resampler.h"
 #include "systemstub.h"
 #include "util.h"
 
@@ -17,6 +19,14 @@ Mixer::Mixer(FileSystem *fs, SystemStub *stub)
 void Mixer::init() {
 	memset(_channels, 0, sizeof(_channels));
 	_premixHook = 0;
+	_premixHookData = 0;
+	setResampleQuality(g_options.audio_resampler);
+	SDL_AtomicSet(&_commandsWritePos, 0);
+	SDL_AtomicSet(&_commandsReadPos, 0);
+	SDL_AtomicSet(&_mixing, 0);
+	for (int i = 0; i < NUM_CHANNELS; ++i) {
+		SDL_AtomicSetPtr(&_channelsData[i], 0);
+	}
 	_stub->startAudio(Mixer::mixCallback, this);
 }
 
@@ -26,16 +36,57 @@ void Mixer::free() {
 	_stub->stopAudio();
 }
 
-void Mixer::setPremixHook(PremixHook premixHook, void *userData) {
-	debug(DBG_SND, "Mixer::setPremixHook()");
-	LockAudioStack las(_stub);
-	_premixHook = premixHook;
-	_premixHookData = userData;
+void Mixer::pushCommand(const MixerCommand &cmd) {
+	const int writePos = SDL_AtomicGet(&_commandsWritePos);
+	while (writePos - SDL_AtomicGet(&_commandsReadPos) >= NUM_COMMANDS) {
+		if (cmd.type == MixerCommand::PLAY) {
+			warning("Mixer::pushCommand() queue full, dropping sound");
+			return;
+		}
+		_stub->sleep(1);
+	}
+	_commands[writePos & (NUM_COMMANDS - 1)] = cmd;
+	SDL_AtomicSet(&_commandsWritePos, writePos + 1);
 }
 
-void Mixer::play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume) {
-	debug(DBG_SND, "Mixer::play(%d, %d)", freq, volume);
-	LockAudioStack las(_stub);
+// returns once the audio callback can no longer reference anything the queued commands replaced
+void Mixer::waitCommands() {
+	const int writePos = SDL_AtomicGet(&_commandsWritePos);
+	// a mix started after the commands were queued drains them before touching any channel or hook
+	while (SDL_AtomicGet(&_mixing) && SDL_AtomicGet(&_commandsReadPos) != writePos) {
+		_stub->sleep(1);
+	}
+}
+
+void Mixer::processCommands() {
+	const int writePos = SDL_AtomicGet(&_commandsWritePos);
+	int readPos = SDL_AtomicGet(&_commandsReadPos);
+	if (readPos == writePos) {
+		return;
+	}
+	for (; readPos != writePos; ++readPos) {
+		const MixerCommand *cmd = &_commands[readPos & (NUM_COMMANDS - 1)];
+		switch (cmd->type) {
+		case MixerCommand::PLAY:
+			playChannel(cmd->data, cmd->len, cmd->freq, cmd->volume, cmd->pcm);
+			break;
+		case MixerCommand::STOP_ALL:
+			for (int i = 0; i < NUM_CHANNELS; ++i) {
+				_channels[i].active = false;
+			}
+			break;
+		case MixerCommand::SET_PREMIX_HOOK:
+			_premixHook = cmd->premixHook;
+			_premixHookData = cmd->premixHookData;
+			break;
+		}
+	}
+	// the channels state must be visible before the commands are marked as consumed, see isPlaying()
+	publishChannels();
+	SDL_AtomicSet(&_commandsReadPos, writePos);
+}
+
+void Mixer::playChannel(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume, const int16_t *pcm) {
 	MixerChannel *ch = 0;
 	for (int i = 0; i < NUM_CHANNELS; ++i) {
 		MixerChannel *cur = &_channels[i];
@@ -54,21 +105,77 @@ void Mixer::play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volum
 		ch->volume = volume;
 		ch->chunk.data = data;
 		ch->chunk.len = len;
+		ch->chunk.pcm = pcm;
 		ch->chunkPos = 0;
-		ch->chunkInc = (freq << FRAC_BITS) / _stub->getOutputSampleRate();
+		// the position of a 16-bit chunk is not fixed point
+		ch->chunkInc = pcm ? 1 : (freq << FRAC_BITS) / _stub->getOutputSampleRate();
 	}
 }
 
+void Mixer::publishChannels() {
+	for (int i = 0; i < NUM_CHANNELS; ++i) {
+		const MixerChannel *ch = &_channels[i];
+		SDL_AtomicSetPtr(&_channelsData[i], ch->active ? (void *)ch->chunk.data : 0);
+	}
+}
+
+void Mixer::setPremixHook(PremixHook premixHook, void *userData) {
+	debug(DBG_SND, "Mixer::setPremixHook()");
+	MixerCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = MixerCommand::SET_PREMIX_HOOK;
+	cmd.premixHook = premixHook;
+	cmd.premixHookData = userData;
+	pushCommand(cmd);
+	// the previous hook data may be released by the caller
+	waitCommands();
+}
+
+void Mixer::play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume) {
+	debug(DBG_SND, "Mixer::play(%d, %d)", freq, volume);
+	MixerCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = MixerCommand::PLAY;
+	cmd.volume = volume;
+	cmd.freq = freq;
+	cmd.data = data;
+	cmd.len = len;
+	pushCommand(cmd);
+}
+
+void Mixer::playPcm(const uint8_t *data, const int16_t *pcm, uint32_t len, uint8_t volume) {
+	debug(DBG_SND, "Mixer::playPcm(%d, %d)", len, volume);
+	MixerCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = MixerCommand::PLAY;
+	cmd.volume = volume;
+	cmd.data = data;
+	cmd.len = len;
+	cmd.pcm = pcm;
+	pushCommand(cmd);
+}
+
 bool Mixer::isPlaying(const uint8_t *data) const {
 	debug(DBG_SND, "Mixer::isPlaying");
-	LockAudioStack las(_stub);
+	const int readPos = SDL_AtomicGet(&_commandsReadPos);
+	const int writePos = SDL_AtomicGet(&_commandsWritePos);
+	bool playing = false;
 	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		const MixerChannel *ch = &_channels[i];
-		if (ch->active && ch->chunk.data == data) {
-			return true;
+		if (SDL_AtomicGetPtr((void **)&_channelsData[i]) == data) {
+			playing = true;
+			break;
+		}
+	}
+	// replay the commands not yet consumed by the audio callback, they are only written by this thread
+	for (int pos = readPos; pos != writePos; ++pos) {
+		const MixerCommand *cmd = &_commands[pos & (NUM_COMMANDS - 1)];
+		if (cmd->type == MixerCommand::PLAY && cmd->data == data) {
+			playing = true;
+		} else if (cmd->type == MixerCommand::STOP_ALL) {
+			playing = false;
 		}
 	}
-	return false;
+	return playing;
 }
 
 uint32_t Mixer::getSampleRate() const {
@@ -77,10 +184,12 @@ uint32_t Mixer::getSampleRate() const {
 
 void Mixer::stopAll() {
 	debug(DBG_SND, "Mixer::stopAll()");
-	LockAudioStack las(_stub);
-	for (uint8_t i = 0; i < NUM_CHANNELS; ++i) {
-		_channels[i].active = false;
-	}
+	MixerCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = MixerCommand::STOP_ALL;
+	pushCommand(cmd);
+	// the sample data may be released by the caller
+	waitCommands();
 }
 
 static bool isMusicSfx(int num) {
@@ -118,26 +227,47 @@ void Mixer::stopMusic() {
 }
 
 void Mixer::mix(int16_t *out, int len) {
+	SDL_AtomicSet(&_mixing, 1);
+	processCommands();
 	if (_premixHook) {
 		if (!_premixHook(_premixHookData, out, len)) {
 			_premixHook = 0;
 			_premixHookData = 0;
 		}
 	}
-	for (uint8_t i = 0; i < NUM_CHANNELS; ++i) {
-		MixerChannel *ch = &_channels[i];
-		if (ch->active) {
-			for (int pos = 0; pos < len; ++pos) {
-				if ((ch->chunkPos >> FRAC_BITS) >= (ch->chunk.len - 1)) {
+	int32_t acc[kMixBlockSize];
+	while (len != 0) {
+		const int count = MIN(len, (int)kMixBlockSize);
+		mixLoadS16(acc, out, count);
+		for (int i = 0; i < NUM_CHANNELS; ++i) {
+			MixerChannel *ch = &_channels[i];
+			if (ch->active && ch->chunk.pcm) {
+				const int n = MIN((uint32_t)count, ch->chunk.len - ch->chunkPos);
+				mixS16(acc, ch->chunk.pcm + ch->chunkPos, n, mixGain(ch->volume, MAX_VOLUME));
+				ch->chunkPos += n;
+				if (n < count) {
+					ch->active = false;
+					SDL_AtomicSetPtr(&_channelsData[i], 0);
+				}
+			} else if (ch->active) {
+				// the last sample of the chunk is not played
+				const uint64_t end = (uint64_t)(ch->chunk.len - 1) << FRAC_BITS;
+				int n = 0;
+				if (ch->chunk.len > 1 && ch->chunkPos < end) {
+					n = MIN((uint64_t)count, (end - ch->chunkPos + ch->chunkInc - 1) / ch->chunkInc);
+				}
+				ch->chunkPos = mixS8(acc, ch->chunk.data, ch->chunk.len, ch->chunkPos, ch->chunkInc, n, mixGain(ch->volume, MAX_VOLUME));
+				if (n < count) {
 					ch->active = false;
-					break;
+					SDL_AtomicSetPtr(&_channelsData[i], 0);
 				}
-				const int sample = ch->chunk.getPCM(ch->chunkPos >> FRAC_BITS) * ch->volume / Mixer::MAX_VOLUME;
-				out[pos] = ADDC_S16(out[pos], S8_to_S16(sample));
-				ch->chunkPos += ch->chunkInc;
 			}
 		}
+		mixClipS16(out, acc, count);
+		out += count;
+		len -= count;
 	}
+	SDL_AtomicSet(&_mixing, 0);
 }
 
 void Mixer::mixCallback(void *param, int16_t *buf, int len) {
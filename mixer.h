@@ -7,6 +7,7 @@
 #ifndef MIXER_H__
 #define MIXER_H__
 
+#include <SDL_atomic.h>
 #include "intern.h"
 #include "mod_player.h"
 #include "sfx_player.h"
@@ -14,9 +15,10 @@
 struct MixerChunk {
 	const uint8_t *data;
 	uint32_t len;
+	const int16_t *pcm; // already at the output rate, 'data' is only used to identify the sound
 
 	MixerChunk()
-		: data(0), len(0) {
+		: data(0), len(0), pcm(0) {
 	}
 
 	int8_t getPCM(int offset) const {
@@ -37,6 +39,22 @@ struct MixerChannel {
 	uint32_t chunkInc;
 };
 
+struct MixerCommand {
+	enum {
+		PLAY,
+		STOP_ALL,
+		SET_PREMIX_HOOK
+	};
+	uint8_t type;
+	uint8_t volume;
+	uint16_t freq;
+	const uint8_t *data;
+	uint32_t len;
+	const int16_t *pcm;
+	bool (*premixHook)(void *userData, int16_t *buf, int len);
+	void *premixHookData;
+};
+
 struct FileSystem;
 struct SystemStub;
 
@@ -53,7 +71,8 @@ struct Mixer {
 		MUSIC_TRACK = 1000,
 		NUM_CHANNELS = 4,
 		FRAC_BITS = 12,
-		MAX_VOLUME = 64
+		MAX_VOLUME = 64,
+		NUM_COMMANDS = 64 // power of two
 	};
 
 	FileSystem *_fs;
@@ -61,6 +80,13 @@ struct Mixer {
 	MixerChannel _channels[NUM_CHANNELS];
 	PremixHook _premixHook;
 	void *_premixHookData;
+	// single producer (game thread), single consumer (audio callback)
+	MixerCommand _commands[NUM_COMMANDS];
+	mutable SDL_atomic_t _commandsWritePos;
+	mutable SDL_atomic_t _commandsReadPos;
+	SDL_atomic_t _mixing;
+	// chunk data of the active channels, as seen by the game thread
+	void *_channelsData[NUM_CHANNELS];
 	MusicType _backgroundMusicType;
 	MusicType _musicType;
 	ModPlayer _mod;
@@ -70,8 +96,14 @@ struct Mixer {
 	Mixer(FileSystem *fs, SystemStub *stub);
 	void init();
 	void free();
+	void pushCommand(const MixerCommand &cmd);
+	void waitCommands();
+	void processCommands();
+	void playChannel(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume, const int16_t *pcm);
+	void publishChannels();
 	void setPremixHook(PremixHook premixHook, void *userData);
 	void play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume);
+	void playPcm(const uint8_t *data, const int16_t *pcm, uint32_t len, uint8_t volume);
 	bool isPlaying(const uint8_t *data) const;
 	uint32_t getSampleRate() const;
 	void stopAll();
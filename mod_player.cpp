@@ -5,8 +5,10 @@
  */
 
 #include "file.h"
+#include "mix_kernels.h"
 #include "mixer.h"
 #include "mod_player.h"
+#include "util.h"
 
 #ifdef USE_MODPLUG
 #include <libmodplug/modplug.h>
@@ -586,42 +588,47 @@ void ModPlayer_impl::handleTick() {
 }
 
 void ModPlayer_impl::mixSamples(int16_t *buf, int samplesLen) {
-	for (int i = 0; i < NUM_TRACKS; ++i) {
-		Track *tk = &_tracks[i];
-		if (tk->sample != 0 && tk->delayCounter == 0) {
-			int16_t *mixbuf = buf;
-			SampleInfo *si = tk->sample;
-			int len = si->len << FRAC_BITS;
-			int loopLen = si->repeatLen << FRAC_BITS;
-			int loopPos = si->repeatPos << FRAC_BITS;
-			int deltaPos = (tk->freq << FRAC_BITS) / _mixingRate;
-			int curLen = samplesLen;
-			int pos = tk->pos;
-			while (curLen != 0) {
-				int count;
-				if (loopLen > (2 << FRAC_BITS)) {
-					if (pos >= loopPos + loopLen) {
-						pos -= loopLen;
-					}
-					count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
-					curLen -= count;
-				} else {
-					if (pos >= len) {
-						count = 0;
+	int32_t acc[kMixBlockSize];
+	while (samplesLen != 0) {
+		const int blockLen = MIN(samplesLen, (int)kMixBlockSize);
+		memset(acc, 0, sizeof(int32_t) * blockLen);
+		for (int i = 0; i < NUM_TRACKS; ++i) {
+			Track *tk = &_tracks[i];
+			if (tk->sample != 0 && tk->delayCounter == 0) {
+				int32_t *mixbuf = acc;
+				SampleInfo *si = tk->sample;
+				int len = si->len << FRAC_BITS;
+				int loopLen = si->repeatLen << FRAC_BITS;
+				int loopPos = si->repeatPos << FRAC_BITS;
+				int deltaPos = (tk->freq << FRAC_BITS) / _mixingRate;
+				const int gain = mixGain(tk->volume, 64);
+				int curLen = blockLen;
+				int pos = tk->pos;
+				while (curLen != 0) {
+					int count;
+					if (loopLen > (2 << FRAC_BITS)) {
+						if (pos >= loopPos + loopLen) {
+							pos -= loopLen;
+						}
+						count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
+						curLen -= count;
 					} else {
-						count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
+						if (pos >= len) {
+							count = 0;
+						} else {
+							count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
+						}
+						curLen = 0;
 					}
-					curLen = 0;
-				}
-				while (count--) {
-					const int out = si->getPCM(pos >> FRAC_BITS) * tk->volume / 64;
-					*mixbuf = ADDC_S16(*mixbuf, S8_to_S16(out));
-					++mixbuf;
-					pos += deltaPos;
+					pos = mixS8(mixbuf, (const uint8_t *)si->data, si->len, pos, deltaPos, count, gain);
+					mixbuf += count;
 				}
+				tk->pos = pos;
 			}
-			tk->pos = pos;
 		}
+		mixClipS16(buf, acc, blockLen);
+		buf += blockLen;
+		samplesLen -= blockLen;
 	}
 }
 
@@ -649,15 +656,23 @@ bool ModPlayer_impl::mix(int16_t *buf, int len) {
 #endif
 
 ModPlayer::ModPlayer(Mixer *mixer, FileSystem *fs)
-	: _playing(false), _mix(mixer), _fs(fs) {
+	: _playing(false), _mix(mixer), _fs(fs), _prerender(false), _ring(0), _renderThread(0) {
 	_impl = new ModPlayer_impl;
 }
 
 ModPlayer::~ModPlayer() {
 	delete _impl;
+	free(_ring);
+}
+
+static int renderThread(void *param) {
+	((ModPlayer *)param)->renderLoop();
+	return 0;
 }
 
 void ModPlayer::play(int num) {
+	// the render thread of the current module must be joined before the player state is reset
+	stop();
 	if (num < _modulesFilesCount) {
 		File f;
 		for (uint8_t i = 0; i < ARRAYSIZE(_modulesFiles[num]); ++i) {
@@ -665,8 +680,35 @@ void ModPlayer::play(int num) {
 				_impl->init(_mix->getSampleRate());
 				if (_impl->load(&f)) {
 					_impl->_repeatIntro = (num == 0) && !_isAmiga;
-					_mix->setPremixHook(mixCallback, _impl);
 					_playing = true;
+					_prerender = g_options.prerender_music;
+					if (_prerender && !_ring) {
+						_ring = (int16_t *)malloc(kRingSize * sizeof(int16_t));
+						if (!_ring) {
+							warning("Unable to allocate music ring buffer");
+							_prerender = false;
+						}
+					}
+					if (_prerender) {
+						SDL_AtomicSet(&_ringWritePos, 0);
+						SDL_AtomicSet(&_ringReadPos, 0);
+						SDL_AtomicSet(&_renderDone, 0);
+						SDL_AtomicSet(&_renderQuit, 0);
+						_underrunsCount = 0;
+						// start with some samples ready, the first callback must not wait for the thread
+						while (SDL_AtomicGet(&_ringWritePos) < kPrefillSize && renderChunk()) {
+						}
+						_renderThread = SDL_CreateThread(renderThread, "mod_render", this);
+						if (!_renderThread) {
+							warning("Unable to create music render thread");
+							_prerender = false;
+						}
+					}
+					if (_prerender) {
+						_mix->setPremixHook(ringCallback, this);
+					} else {
+						_mix->setPremixHook(mixCallback, _impl);
+					}
 				}
 				return;
 			}
@@ -677,11 +719,68 @@ void ModPlayer::play(int num) {
 void ModPlayer::stop() {
 	if (_playing) {
 		_mix->setPremixHook(0, 0);
+		if (_renderThread) {
+			SDL_AtomicSet(&_renderQuit, 1);
+			SDL_WaitThread(_renderThread, 0);
+			_renderThread = 0;
+		}
+		if (_prerender && _underrunsCount != 0) {
+			warning("Music ring buffer ran dry %d times", _underrunsCount);
+		}
 		_impl->unload();
 		_playing = false;
 	}
 }
 
+// producer side, renders one chunk if the ring has room for it
+bool ModPlayer::renderChunk() {
+	const int writePos = SDL_AtomicGet(&_ringWritePos);
+	if (writePos - SDL_AtomicGet(&_ringReadPos) > kRingSize - kRenderChunkSize) {
+		return false;
+	}
+	// the ring size is a multiple of the chunk size, a chunk never wraps
+	if (!_impl->mix(_ring + (writePos & (kRingSize - 1)), kRenderChunkSize)) {
+		SDL_AtomicSet(&_renderDone, 1);
+		return false;
+	}
+	SDL_AtomicSet(&_ringWritePos, writePos + kRenderChunkSize);
+	return true;
+}
+
+void ModPlayer::renderLoop() {
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+	// poll at a quarter of the duration of a chunk
+	const int delay = MAX(1, kRenderChunkSize * 1000 / (int)_mix->getSampleRate() / 4);
+	while (!SDL_AtomicGet(&_renderQuit) && !SDL_AtomicGet(&_renderDone)) {
+		if (!renderChunk()) {
+			SDL_Delay(delay);
+		}
+	}
+}
+
+// consumer side, called from the audio callback
+bool ModPlayer::readRing(int16_t *buf, int len) {
+	const int readPos = SDL_AtomicGet(&_ringReadPos);
+	const int count = MIN(len, SDL_AtomicGet(&_ringWritePos) - readPos);
+	const int offset = readPos & (kRingSize - 1);
+	const int count1 = MIN(count, kRingSize - offset);
+	memcpy(buf, _ring + offset, count1 * sizeof(int16_t));
+	memcpy(buf + count1, _ring, (count - count1) * sizeof(int16_t));
+	SDL_AtomicSet(&_ringReadPos, readPos + count);
+	if (count < len) {
+		memset(buf + count, 0, (len - count) * sizeof(int16_t));
+		if (SDL_AtomicGet(&_renderDone)) {
+			return false;
+		}
+		++_underrunsCount;
+	}
+	return true;
+}
+
 bool ModPlayer::mixCallback(void *param, int16_t *buf, int len) {
 	return ((ModPlayer_impl *)param)->mix(buf, len);
 }
+
+bool ModPlayer::ringCallback(void *param, int16_t *buf, int len) {
+	return ((ModPlayer *)param)->readRing(buf, len);
+}
@@ -7,6 +7,8 @@
 #ifndef MOD_PLAYER_H__
 #define MOD_PLAYER_H__
 
+#include <SDL_atomic.h>
+#include <SDL_thread.h>
 #include "intern.h"
 
 struct FileSystem;
@@ -14,6 +16,11 @@ struct Mixer;
 struct ModPlayer_impl;
 
 struct ModPlayer {
+	enum {
+		kRingSize = 1 << 15, // power of two
+		kRenderChunkSize = 1024,
+		kPrefillSize = 4 * kRenderChunkSize
+	};
 
 	static const uint16_t _periodTable[];
 	static const char *_modulesFiles[][2];
@@ -24,6 +31,15 @@ struct ModPlayer {
 	Mixer *_mix;
         FileSystem *_fs;
 	ModPlayer_impl *_impl;
+	// the module is rendered ahead by a thread, the audio callback only reads the ring
+	bool _prerender;
+	int16_t *_ring;
+	SDL_atomic_t _ringWritePos;
+	SDL_atomic_t _ringReadPos;
+	SDL_atomic_t _renderDone;
+	SDL_atomic_t _renderQuit;
+	SDL_Thread *_renderThread;
+	uint32_t _underrunsCount;
 
         ModPlayer(Mixer *mixer, FileSystem *fs);
 	~ModPlayer();
@@ -31,7 +47,12 @@ struct ModPlayer {
 	void play(int num);
 	void stop();
 
+	bool renderChunk();
+	void renderLoop();
+	bool readRing(int16_t *buf, int len);
+
 	static bool mixCallback(void *param, int16_t *buf, int len);
+	static bool ringCallback(void *param, int16_t *buf, int len);
 };
 
 #endif // MOD_PLAYER_H__
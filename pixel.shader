@@ -1,6 +1,8 @@
 #version 110
 varying vec2 texCoord;
 uniform sampler2D source;
+uniform sampler2D palette;
+uniform int use_palette;
 uniform float trg_x;
 uniform float trg_y;
 uniform float trg_w;
@@ -43,11 +45,18 @@ vec3 ToLinear(vec3 c){return vec3(ToLinear1(c.r),ToLinear1(c.g),ToLinear1(c.b));
 float ToSrgb1(float c){return(c<0.0031308?c*12.92:1.055*pow(c,0.41666)-0.055);}
 vec3 ToSrgb(vec3 c){return vec3(ToSrgb1(c.r),ToSrgb1(c.g),ToSrgb1(c.b));}
 
+// Source color, looked up in the palette texture when the source holds 8-bit indexes.
+vec3 Texel(vec2 pos){
+    if(use_palette!=0){
+        float index=floor(texture2D(source,pos,-16.0).r*255.0+0.5);
+        return texture2D(palette,vec2((index+0.5)/256.0,0.5)).rgb;}
+    return texture2D(source,pos,-16.0).rgb;}
+
 // Nearest emulated sample given floating point position and texel offset.
 // Also zero's off screen.
 vec3 Fetch(vec2 pos,vec2 off){
     pos=(floor(pos*res+off)+vec2(0.5,0.5))/res;
-    return ToLinear(1.2 * texture2D(source,pos.xy,-16.0).rgb);}
+    return ToLinear(1.2 * Texel(pos.xy));}
 
 // Distance in emulated pixels to nearest texel.
 vec2 Dist(vec2 pos){pos=pos*res;return -((pos-floor(pos))-vec2(0.5));}
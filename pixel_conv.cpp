@@ -0,0 +1,207 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <SDL.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define PIXEL_CONV_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_CONV_NEON
+#endif
+#include "pixel_conv.h"
+#include "util.h"
+
+#if defined(PIXEL_CONV_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+typedef void (*ConvertPal8Proc)(uint32_t *dst, const uint8_t *src, int count, const uint32_t *pal);
+typedef void (*ConvertRgbaProc)(uint32_t *dst, const uint8_t *src, int count);
+
+static void convertPal8_C(uint32_t *dst, const uint8_t *src, int count, const uint32_t *pal) {
+	for (; count >= 4; count -= 4) {
+		dst[0] = pal[src[0]];
+		dst[1] = pal[src[1]];
+		dst[2] = pal[src[2]];
+		dst[3] = pal[src[3]];
+		dst += 4;
+		src += 4;
+	}
+	for (; count > 0; --count) {
+		*dst++ = pal[*src++];
+	}
+}
+
+// destination bytes in R,G,B,A memory order, eg. ABGR8888 on little endian
+static void convertRgba_C(uint32_t *dst, const uint8_t *src, int count) {
+	uint8_t *p = (uint8_t *)dst;
+	for (; count > 0; --count) {
+		p[0] = src[0];
+		p[1] = src[1];
+		p[2] = src[2];
+		p[3] = 255;
+		p += 4;
+		src += 3;
+	}
+}
+
+#ifdef PIXEL_CONV_X86
+// no gather instruction, the lookups stay scalar but the stores are 128 bits wide
+TARGET_SSE2 static void convertPal8_SSE2(uint32_t *dst, const uint8_t *src, int count, const uint32_t *pal) {
+	for (; count >= 8; count -= 8) {
+		const __m128i p0 = _mm_setr_epi32(pal[src[0]], pal[src[1]], pal[src[2]], pal[src[3]]);
+		const __m128i p1 = _mm_setr_epi32(pal[src[4]], pal[src[5]], pal[src[6]], pal[src[7]]);
+		_mm_storeu_si128((__m128i *)dst, p0);
+		_mm_storeu_si128((__m128i *)(dst + 4), p1);
+		dst += 8;
+		src += 8;
+	}
+	convertPal8_C(dst, src, count, pal);
+}
+
+TARGET_AVX2 static void convertPal8_AVX2(uint32_t *dst, const uint8_t *src, int count, const uint32_t *pal) {
+	for (; count >= 16; count -= 16) {
+		const __m128i idx = _mm_loadu_si128((const __m128i *)src);
+		const __m256i i0 = _mm256_cvtepu8_epi32(idx);
+		const __m256i i1 = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+		_mm256_storeu_si256((__m256i *)dst, _mm256_i32gather_epi32((const int *)pal, i0, 4));
+		_mm256_storeu_si256((__m256i *)(dst + 8), _mm256_i32gather_epi32((const int *)pal, i1, 4));
+		dst += 16;
+		src += 16;
+	}
+	convertPal8_C(dst, src, count, pal);
+}
+
+TARGET_SSSE3 static void convertRgba_SSSE3(uint32_t *dst, const uint8_t *src, int count) {
+	const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	// each 16 bytes load only consumes 4 pixels, keep enough input for the last load
+	for (; count >= 8; count -= 4) {
+		const __m128i rgb = _mm_loadu_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_shuffle_epi8(rgb, shuf), alpha));
+		dst += 4;
+		src += 12;
+	}
+	convertRgba_C(dst, src, count);
+}
+#endif
+
+#ifdef PIXEL_CONV_NEON
+static void convertPal8_NEON(uint32_t *dst, const uint8_t *src, int count, const uint32_t *pal) {
+	for (; count >= 8; count -= 8) {
+		uint32x4_t p0 = vdupq_n_u32(pal[src[0]]);
+		p0 = vsetq_lane_u32(pal[src[1]], p0, 1);
+		p0 = vsetq_lane_u32(pal[src[2]], p0, 2);
+		p0 = vsetq_lane_u32(pal[src[3]], p0, 3);
+		uint32x4_t p1 = vdupq_n_u32(pal[src[4]]);
+		p1 = vsetq_lane_u32(pal[src[5]], p1, 1);
+		p1 = vsetq_lane_u32(pal[src[6]], p1, 2);
+		p1 = vsetq_lane_u32(pal[src[7]], p1, 3);
+		vst1q_u32(dst, p0);
+		vst1q_u32(dst + 4, p1);
+		dst += 8;
+		src += 8;
+	}
+	convertPal8_C(dst, src, count, pal);
+}
+
+static void convertRgba_NEON(uint32_t *dst, const uint8_t *src, int count) {
+	uint8x16x4_t rgba;
+	rgba.val[3] = vdupq_n_u8(255);
+	for (; count >= 16; count -= 16) {
+		const uint8x16x3_t rgb = vld3q_u8(src);
+		rgba.val[0] = rgb.val[0];
+		rgba.val[1] = rgb.val[1];
+		rgba.val[2] = rgb.val[2];
+		vst4q_u8((uint8_t *)dst, rgba);
+		dst += 16;
+		src += 48;
+	}
+	convertRgba_C(dst, src, count);
+}
+#endif
+
+static ConvertPal8Proc _convertPal8;
+static ConvertRgbaProc _convertRgba;
+
+static void initPixelConv() {
+	const char *name = "C";
+	_convertPal8 = convertPal8_C;
+	_convertRgba = convertRgba_C;
+#ifdef PIXEL_CONV_X86
+	if (SDL_HasAVX2()) {
+		name = "AVX2";
+		_convertPal8 = convertPal8_AVX2;
+	} else if (SDL_HasSSE2()) {
+		name = "SSE2";
+		_convertPal8 = convertPal8_SSE2;
+	}
+	if (SDL_HasSSSE3()) {
+		_convertRgba = convertRgba_SSSE3;
+	}
+#endif
+#ifdef PIXEL_CONV_NEON
+	if (SDL_HasNEON()) {
+		name = "NEON";
+		_convertPal8 = convertPal8_NEON;
+		_convertRgba = convertRgba_NEON;
+	}
+#endif
+	debug(DBG_VIDEO, "Using %s pixel conversion", name);
+}
+
+void convertPal8(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *pal) {
+	if (!_convertPal8) {
+		initPixelConv();
+	}
+	if (w == dstPitch && w == srcPitch) {
+		// contiguous rows, eg. full screen refresh
+		_convertPal8(dst, src, w * h, pal);
+		return;
+	}
+	for (int j = 0; j < h; ++j) {
+		_convertPal8(dst, src, w, pal);
+		dst += dstPitch;
+		src += srcPitch;
+	}
+}
+
+static bool isRgbaByteOrder(int rShift, int gShift, int bShift, uint32_t aMask) {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	return rShift == 0 && gShift == 8 && bShift == 16 && aMask == 0xFF000000;
+#else
+	return rShift == 24 && gShift == 16 && bShift == 8 && aMask == 0xFF;
+#endif
+}
+
+void convertRgb24(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int rShift, int gShift, int bShift, uint32_t aMask) {
+	if (!_convertPal8) {
+		initPixelConv();
+	}
+	if (isRgbaByteOrder(rShift, gShift, bShift, aMask)) {
+		for (int j = 0; j < h; ++j) {
+			_convertRgba(dst, src, w);
+			dst += dstPitch;
+			src += srcPitch;
+		}
+		return;
+	}
+	for (int j = 0; j < h; ++j) {
+		const uint8_t *rgb = src;
+		for (int i = 0; i < w; ++i) {
+			dst[i] = (rgb[0] << rShift) | (rgb[1] << gShift) | (rgb[2] << bShift) | aMask;
+			rgb += 3;
+		}
+		dst += dstPitch;
+		src += srcPitch;
+	}
+}
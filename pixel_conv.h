@@ -0,0 +1,15 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PIXEL_CONV_H__
+#define PIXEL_CONV_H__
+
+#include "intern.h"
+
+// pitches are in pixels, the implementation is selected at runtime from the CPU features
+extern void convertPal8(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *pal);
+extern void convertRgb24(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int rShift, int gShift, int bShift, uint32_t aMask);
+
+#endif // PIXEL_CONV_H__
@@ -0,0 +1,102 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifdef USE_PROFILER
+
+#include <SDL.h>
+#include "profiler.h"
+#include "util.h"
+
+// logarithmic buckets, 8 per power of two (12.5% resolution)
+static const int kSubBucketsBits = 3;
+static const int kBucketsCount = 32 << kSubBucketsBits;
+
+struct PhaseStats {
+	uint32_t count;
+	uint64_t total;
+	uint32_t min, max;
+	uint32_t buckets[kBucketsCount];
+};
+
+static const char *_phaseNames[] = {
+	"pge_getInput",
+	"pge_prepare",
+	"col_prepareRoomState",
+	"pge_process",
+	"loadLevelMap",
+	"prepare/drawAnims",
+	"updateScreen",
+	"updateTiming"
+};
+
+static PhaseStats _phases[kProfilerPhasesCount];
+
+static uint64_t getCounterUs() {
+	static const uint64_t freq = SDL_GetPerformanceFrequency();
+	const uint64_t counter = SDL_GetPerformanceCounter();
+	return (counter / freq) * 1000000 + (counter % freq) * 1000000 / freq;
+}
+
+static int getBucket(uint32_t us) {
+	if (us < (1U << kSubBucketsBits)) {
+		return us;
+	}
+	int bits = 0;
+	while ((us >> bits) >= (2U << kSubBucketsBits)) {
+		++bits;
+	}
+	const int bucket = ((bits + 1) << kSubBucketsBits) + ((us >> bits) & ((1 << kSubBucketsBits) - 1));
+	return MIN(bucket, kBucketsCount - 1);
+}
+
+static uint32_t getBucketValue(int bucket) {
+	if (bucket < (1 << kSubBucketsBits)) {
+		return bucket;
+	}
+	const int bits = (bucket >> kSubBucketsBits) - 1;
+	return ((1 << kSubBucketsBits) + (bucket & ((1 << kSubBucketsBits) - 1))) << bits;
+}
+
+ProfilerScope::ProfilerScope(int phase)
+	: _phase(phase) {
+	_start = getCounterUs();
+}
+
+ProfilerScope::~ProfilerScope() {
+	const uint32_t us = (uint32_t)(getCounterUs() - _start);
+	PhaseStats *ps = &_phases[_phase];
+	if (ps->count == 0 || us < ps->min) {
+		ps->min = us;
+	}
+	if (us > ps->max) {
+		ps->max = us;
+	}
+	ps->total += us;
+	++ps->count;
+	++ps->buckets[getBucket(us)];
+}
+
+void Profiler_dump() {
+	debug(DBG_INFO, "%-20s %8s %8s %8s %8s %8s", "phase (us)", "count", "min", "avg", "p99", "max");
+	for (int i = 0; i < kProfilerPhasesCount; ++i) {
+		const PhaseStats *ps = &_phases[i];
+		if (ps->count == 0) {
+			continue;
+		}
+		uint32_t p99 = ps->max;
+		const uint32_t threshold = ps->count - ps->count / 100;
+		uint32_t sum = 0;
+		for (int b = 0; b < kBucketsCount; ++b) {
+			sum += ps->buckets[b];
+			if (sum >= threshold) {
+				p99 = MIN(getBucketValue(b), ps->max);
+				break;
+			}
+		}
+		debug(DBG_INFO, "%-20s %8d %8d %8d %8d %8d", _phaseNames[i], ps->count, ps->min, (int)(ps->total / ps->count), p99, ps->max);
+	}
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PROFILER_H__
+#define PROFILER_H__
+
+#include "intern.h"
+
+enum ProfilerPhase {
+	kProfilerGetInput,
+	kProfilerPrepare,
+	kProfilerPrepareRoomState,
+	kProfilerProcess,
+	kProfilerLoadLevelMap,
+	kProfilerAnims,
+	kProfilerUpdateScreen,
+	kProfilerUpdateTiming,
+	kProfilerPhasesCount
+};
+
+#ifdef USE_PROFILER
+
+struct ProfilerScope {
+	int _phase;
+	uint64_t _start;
+
+	ProfilerScope(int phase);
+	~ProfilerScope();
+};
+
+extern void Profiler_dump();
+
+#define PROFILE_SCOPE_NAME2(line) profilerScope##line
+#define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_NAME2(line)
+#define PROFILE_SCOPE(phase) ProfilerScope PROFILE_SCOPE_NAME(__LINE__)(phase)
+#define PROFILE_DUMP() Profiler_dump()
+
+#else
+
+#define PROFILE_SCOPE(phase)
+#define PROFILE_DUMP()
+
+#endif
+
+#endif // PROFILER_H__
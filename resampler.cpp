@@ -0,0 +1,151 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <math.h>
+#include "resampler.h"
+#include "util.h"
+
+enum {
+	kPhaseBits = 8,
+	kPhasesCount = 1 << kPhaseBits,
+	kTapBits = 14
+};
+
+static int _quality = kResampleNearest;
+static int16_t _taps[kPhasesCount][4];
+static bool _tapsInit;
+
+static double lanczos2(double x) {
+	x = fabs(x);
+	if (x < 1e-9) {
+		return 1.;
+	} else if (x >= 2.) {
+		return 0.;
+	}
+	const double px = M_PI * x;
+	return 2. * sin(px) * sin(px / 2.) / (px * px);
+}
+
+static void initTaps() {
+	for (int p = 0; p < kPhasesCount; ++p) {
+		const double frac = p / (double)kPhasesCount;
+		double w[4];
+		double sum = 0.;
+		for (int k = 0; k < 4; ++k) {
+			w[k] = lanczos2(k - 1 - frac);
+			sum += w[k];
+		}
+		// normalize so that a constant signal keeps its level
+		int total = 0;
+		for (int k = 0; k < 3; ++k) {
+			_taps[p][k] = (int16_t)floor(w[k] / sum * (1 << kTapBits) + .5);
+			total += _taps[p][k];
+		}
+		_taps[p][3] = (1 << kTapBits) - total;
+	}
+	_tapsInit = true;
+}
+
+void setResampleQuality(int quality) {
+	static const char *names[] = { "nearest", "linear", "polyphase" };
+	if (quality < kResampleNearest || quality > kResamplePolyphase) {
+		warning("Invalid resampler quality %d", quality);
+		quality = kResampleNearest;
+	}
+	_quality = quality;
+	if (_quality == kResamplePolyphase && !_tapsInit) {
+		initTaps();
+	}
+	debug(DBG_SND, "Using %s resampling", names[quality]);
+}
+
+static int16_t clipS16(int sample) {
+	if (sample < -32768) {
+		return -32768;
+	} else if (sample > 32767) {
+		return 32767;
+	}
+	return sample;
+}
+
+// same mapping as S8_to_S16(), -128 is -32768 and 127 is 32767
+static int16_t expandS8(int sample) {
+	return clipS16(sample * kResampleExpandS8 + 128);
+}
+
+// reads 'src[i]' with the index clamped to the buffer
+static int sampleAt(const int8_t *src, uint32_t len, int i) {
+	if (i < 0) {
+		i = 0;
+	} else if ((uint32_t)i >= len) {
+		i = len - 1;
+	}
+	return src[i];
+}
+
+static uint32_t resampleNearest(int16_t *dst, const int8_t *src, uint32_t pos, uint32_t inc, int count) {
+	for (int i = 0; i < count; ++i) {
+		dst[i] = expandS8(src[pos >> kResampleFracBits]);
+		pos += inc;
+	}
+	return pos;
+}
+
+template <bool kClamp>
+static uint32_t resampleLinear(int16_t *dst, const int8_t *src, uint32_t len, uint32_t pos, uint32_t inc, int count) {
+	static const int kFracMask = (1 << kResampleFracBits) - 1;
+	for (int i = 0; i < count; ++i) {
+		const int index = pos >> kResampleFracBits;
+		const int a = src[index];
+		const int b = kClamp ? sampleAt(src, len, index + 1) : src[index + 1];
+		const int frac = pos & kFracMask;
+		dst[i] = clipS16((((a * (1 << kResampleFracBits) + (b - a) * frac) * kResampleExpandS8) >> kResampleFracBits) + 128);
+		pos += inc;
+	}
+	return pos;
+}
+
+template <bool kClamp>
+static uint32_t resamplePolyphase(int16_t *dst, const int8_t *src, uint32_t len, uint32_t pos, uint32_t inc, int count) {
+	for (int i = 0; i < count; ++i) {
+		const int index = pos >> kResampleFracBits;
+		const int16_t *w = _taps[(pos >> (kResampleFracBits - kPhaseBits)) & (kPhasesCount - 1)];
+		int s0, s1, s2, s3;
+		if (kClamp) {
+			s0 = sampleAt(src, len, index - 1);
+			s1 = src[index];
+			s2 = sampleAt(src, len, index + 1);
+			s3 = sampleAt(src, len, index + 2);
+		} else {
+			s0 = src[index - 1];
+			s1 = src[index];
+			s2 = src[index + 1];
+			s3 = src[index + 2];
+		}
+		const int sample = s0 * w[0] + s1 * w[1] + s2 * w[2] + s3 * w[3];
+		dst[i] = clipS16(((sample * kResampleExpandS8) >> kTapBits) + 128);
+		pos += inc;
+	}
+	return pos;
+}
+
+uint32_t resampleS8(int16_t *dst, const uint8_t *src, uint32_t len, uint32_t pos, uint32_t inc, int count) {
+	if (count <= 0) {
+		return pos;
+	}
+	const int8_t *pcm = (const int8_t *)src;
+	// the neighbours of the first and last positions decide if the fetches need clamping
+	const uint32_t first = pos >> kResampleFracBits;
+	const uint32_t last = (pos + (count - 1) * inc) >> kResampleFracBits;
+	const bool inside = first >= 1 && last + 2 < len;
+	switch (_quality) {
+	case kResampleLinear:
+		return inside ? resampleLinear<false>(dst, pcm, len, pos, inc, count) : resampleLinear<true>(dst, pcm, len, pos, inc, count);
+	case kResamplePolyphase:
+		return inside ? resamplePolyphase<false>(dst, pcm, len, pos, inc, count) : resamplePolyphase<true>(dst, pcm, len, pos, inc, count);
+	default:
+		return resampleNearest(dst, pcm, pos, inc, count);
+	}
+}
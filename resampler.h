@@ -0,0 +1,26 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef RESAMPLER_H__
+#define RESAMPLER_H__
+
+#include "intern.h"
+
+enum ResampleQuality {
+	kResampleNearest,
+	kResampleLinear,
+	kResamplePolyphase // 4 taps, lanczos windowed sinc
+};
+
+enum {
+	kResampleFracBits = 12,
+	kResampleExpandS8 = 257 // 8 to 16 bits sample expansion
+};
+
+extern void setResampleQuality(int quality);
+// reads 'count' samples at the fixed point position 'pos' of the 8-bit 'src' buffer holding 'len' samples, returns the next position
+extern uint32_t resampleS8(int16_t *dst, const uint8_t *src, uint32_t len, uint32_t pos, uint32_t inc, int count);
+
+#endif // RESAMPLER_H__
@@ -4,8 +4,11 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <SDL.h>
+#include <ctype.h>
 #include "file.h"
 #include "fs.h"
+#include "resampler.h"
 #include "resource.h"
 #include "unpack.h"
 #include "util.h"
@@ -22,13 +25,16 @@ Resource::Resource(FileSystem *fs, ResourceType ver, Language lang) {
 	if (!_scratchBuffer) {
 		error("Unable to allocate temporary memory buffer");
 	}
-	static const int kBankDataSize = 0x7000;
-	_bankData = (uint8_t *)malloc(kBankDataSize);
+	// an entry must always fit in the arena
+	const int bankDataSize = MAX(g_options.bank_cache_size * 1024, (int)kBankDataSize);
+	_bankData = (uint8_t *)malloc(bankDataSize);
 	if (!_bankData) {
 		error("Unable to allocate bank data buffer");
 	}
-	_bankDataTail = _bankData + kBankDataSize;
+	_bankDataUnits = bankDataSize / 32;
+	memset(_bankBuffersIndex, 0xFF, sizeof(_bankBuffersIndex));
 	clearBankData();
+	freeBankArenas();
 }
 
 Resource::~Resource() {
@@ -36,17 +42,14 @@ Resource::~Resource() {
 	free(_fnt);
 	free(_icn);
 	free(_tab);
-	free(_spc);
-	free(_spr1);
+	freeData(_spc);
+	freeData(_spr1);
 	free(_scratchBuffer);
-	free(_cmd);
-	free(_pol);
+	freeData(_cmd);
+	freeData(_pol);
 	free(_cine_off);
 	free(_cine_txt);
-	for (int i = 0; i < _numSfx; ++i) {
-		free(_sfxList[i].data);
-	}
-	free(_sfxList);
+	freeSfx();
 	free(_bankData);
 }
 
@@ -85,18 +88,58 @@ bool Resource::fileExists(const char *filename) {
 }
 
 void Resource::clearLevelRes() {
+	freeBankArenas();
 	free(_tbn); _tbn = 0;
-	free(_mbk); _mbk = 0;
+	freeData(_mbk); _mbk = 0;
+	_mbkSize = 0;
 	free(_pal); _pal = 0;
-	free(_map); _map = 0;
-	free(_lev); _lev = 0;
+	freeData(_map); _map = 0;
+	freeData(_lev); _lev = 0;
 	_levNum = -1;
 	free(_sgd); _sgd = 0;
 	free(_bnq); _bnq = 0;
+	_bnqSize = 0;
 	free(_ani); _ani = 0;
 	free_OBJ();
 }
 
+static void swapBytes(void *a, void *b, int len) {
+	uint8_t *p = (uint8_t *)a;
+	uint8_t *q = (uint8_t *)b;
+	for (int i = 0; i < len; ++i) {
+		SWAP(p[i], q[i]);
+	}
+}
+
+// exchanges the level data with the one loaded in 'res', only pointers are moved for the file buffers
+void Resource::swapLevelRes(Resource *res) {
+	SWAP(_mbk, res->_mbk);
+	SWAP(_mbkSize, res->_mbkSize);
+	SWAP(_mbkArena, res->_mbkArena);
+	swapBytes(_ctData, res->_ctData, sizeof(_ctData));
+	swapBytes(_rp, res->_rp, sizeof(_rp));
+	SWAP(_pal, res->_pal);
+	if (res->_spc) { // per level on Amiga
+		SWAP(_spc, res->_spc);
+		SWAP(_numSpc, res->_numSpc);
+	}
+	SWAP(_map, res->_map);
+	SWAP(_lev, res->_lev);
+	SWAP(_levNum, res->_levNum);
+	SWAP(_sgd, res->_sgd);
+	SWAP(_bnq, res->_bnq);
+	SWAP(_bnqSize, res->_bnqSize);
+	SWAP(_bnqArena, res->_bnqArena);
+	SWAP(_pgeNum, res->_pgeNum);
+	swapBytes(_pgeInit, res->_pgeInit, sizeof(_pgeInit));
+	SWAP(_numObjectNodes, res->_numObjectNodes);
+	for (int i = 0; i < ARRAYSIZE(_objectNodesMap); ++i) {
+		SWAP(_objectNodesMap[i], res->_objectNodesMap[i]);
+	}
+	SWAP(_ani, res->_ani);
+	SWAP(_tbn, res->_tbn);
+}
+
 void Resource::load_DEM(const char *filename) {
 	free(_dem); _dem = 0;
 	_demLen = 0;
@@ -126,6 +169,8 @@ void Resource::load_FIB(const char *fileName) {
 			sfx->len = f.readUint16LE();
 			sfx->freq = 6000;
 			sfx->data = 0;
+			sfx->pcm = 0;
+			sfx->pcmLen = 0;
 		}
 		for (int i = 0; i < _numSfx; ++i) {
 			SoundFx *sfx = &_sfxList[i];
@@ -207,6 +252,47 @@ void Resource::load_SPL_demo() {
 	}
 }
 
+void Resource::resampleSfx(int outputRate) {
+	// zeroes after the last sample, reading ahead (vector loads, interpolation) needs no bounds check
+	static const int kGuardSamples = 16;
+	uint32_t srcSize = 0;
+	uint32_t dstSize = 0;
+	for (int i = 0; i < _numSfx; ++i) {
+		SoundFx *sfx = &_sfxList[i];
+		free(sfx->pcm);
+		sfx->pcm = 0;
+		sfx->pcmLen = 0;
+		if (!sfx->data || sfx->len < 2) {
+			continue;
+		}
+		// same positions as the 8-bit stepping of Mixer::mix, the last sample is not played
+		const uint32_t inc = (sfx->freq << kResampleFracBits) / outputRate;
+		const uint32_t end = (sfx->len - 1) << kResampleFracBits;
+		const uint32_t len = (end + inc - 1) / inc;
+		sfx->pcm = (int16_t *)malloc((len + kGuardSamples) * sizeof(int16_t));
+		if (!sfx->pcm) {
+			warning("Unable to allocate %d samples for sound %d", len, i);
+			continue;
+		}
+		resampleS8(sfx->pcm, sfx->data, sfx->len, 0, inc, len);
+		memset(sfx->pcm + len, 0, kGuardSamples * sizeof(int16_t));
+		sfx->pcmLen = len;
+		srcSize += sfx->len;
+		dstSize += (len + kGuardSamples) * sizeof(int16_t);
+	}
+	debug(DBG_INFO, "Resampled sound effects to %d Hz, %d bytes (%d bytes of 8-bit samples)", outputRate, dstSize, srcSize);
+}
+
+void Resource::freeSfx() {
+	for (int i = 0; i < _numSfx; ++i) {
+		free(_sfxList[i].data);
+		free(_sfxList[i].pcm);
+	}
+	free(_sfxList);
+	_sfxList = 0;
+	_numSfx = 0;
+}
+
 void Resource::load_MAP_menu(const char *fileName, uint8_t *dstPtr) {
 	debug(DBG_RES, "Resource::load_MAP_menu('%s')", fileName);
 	static const int kMenuMapSize = 0x3800 * 4;
@@ -242,6 +328,7 @@ void Resource::load_PAL_menu(const char *fileName, uint8_t *dstPtr) {
 }
 
 void Resource::load_CMP_menu(const char *fileName) {
+	snprintf(_entryName, sizeof(_entryName), "%s", fileName);
 	File f;
 	if (f.open(fileName, "rb", _fs)) {
 		const uint32_t size = f.readUint32BE();
@@ -250,7 +337,7 @@ void Resource::load_CMP_menu(const char *fileName) {
 			error("Failed to allocate CMP temporary buffer");
 		}
 		f.read(tmp, size);
-		if (!bytekiller_unpack(_scratchBuffer, kScratchBufferSize, tmp, size)) {
+		if (!unpackCached(0, _scratchBuffer, kScratchBufferSize, tmp, size)) {
 			error("Bad CRC for %s", fileName);
 		}
                 free(tmp);
@@ -480,17 +567,17 @@ static const char *getTextBin(Language lang, ResourceType type) {
 void Resource::unload(int objType) {
 	switch (objType) {
 	case OT_CMD:
-		free(_cmd);
+		freeData(_cmd);
 		_cmd = 0;
 		break;
 	case OT_POL:
-		free(_pol);
+		freeData(_pol);
 		_pol = 0;
 		break;
 	case OT_CMP:
-		free(_cmd);
+		freeData(_cmd);
 		_cmd = 0;
-		free(_pol);
+		freeData(_pol);
 		_pol = 0;
 		break;
 	default:
@@ -499,6 +586,156 @@ void Resource::unload(int objType) {
 	}
 }
 
+// raw read-only assets, used in place from the file mapping
+static bool isMappedType(int objType) {
+	switch (objType) {
+	case Resource::OT_MBK:
+	case Resource::OT_MAP:
+	case Resource::OT_LEV:
+	case Resource::OT_SPC:
+	case Resource::OT_SPR:
+	case Resource::OT_CMD:
+	case Resource::OT_POL:
+		return true;
+	}
+	return false;
+}
+
+// returns the mapped file data if available, a heap copy otherwise
+uint8_t *Resource::readData(File *f, uint32_t offset, uint32_t len) {
+	uint8_t *p = f->map();
+	if (p) {
+		return p + offset;
+	}
+	p = (uint8_t *)malloc(len);
+	if (p) {
+		f->seek(offset);
+		f->read(p, len);
+	}
+	return p;
+}
+
+void Resource::freeData(uint8_t *p) {
+	if (!File::unmap(p)) {
+		free(p);
+	}
+}
+
+static const uint32_t kCacheTag = 0x46425543; // 'FBUC'
+static const uint32_t kCacheVersion = 1;
+
+// bytekiller_unpack() of a part of the current entry, the output is saved to a file in the cache directory
+// and read back on the next calls, as long as the size and modification time of the data file do not change
+bool Resource::unpackCached(int part, uint8_t *dst, int dstSize, const uint8_t *src, int srcSize) {
+	uint32_t fileSize, fileTime;
+	if (!_cachePath || !_fs->getFileInfo(_entryName, &fileSize, &fileTime)) {
+		return bytekiller_unpack(dst, dstSize, src, srcSize);
+	}
+	const uint32_t size = READ_BE_UINT32(src + srcSize - 4);
+	const uint32_t header[] = { kCacheTag, kCacheVersion, fileSize, fileTime, size };
+	char name[64];
+	int len = 0;
+	for (; _entryName[len] && len < 48; ++len) {
+		name[len] = toupper(_entryName[len]);
+	}
+	snprintf(name + len, sizeof(name) - len, ".%d.cache", part);
+	File f;
+	if (!_rebuildCache && f.open(name, "rb", _cachePath)) {
+		bool match = true;
+		for (int i = 0; i < ARRAYSIZE(header); ++i) {
+			if (f.readUint32BE() != header[i]) {
+				match = false;
+			}
+		}
+		if (match && (int)size <= dstSize && f.read(dst, size) == size && !f.ioErr()) {
+			debug(DBG_RES, "Read '%s' from the cache", name);
+			return true;
+		}
+		debug(DBG_RES, "Cache file '%s' is outdated", name);
+	}
+	if (!bytekiller_unpack(dst, dstSize, src, srcSize)) {
+		return false;
+	}
+	if (f.open(name, "wb", _cachePath)) {
+		for (int i = 0; i < ARRAYSIZE(header); ++i) {
+			f.writeUint32BE(header[i]);
+		}
+		f.write(dst, size);
+		if (f.ioErr()) {
+			warning("I/O error when writing '%s'", name);
+		}
+	}
+	return true;
+}
+
+// unpacks all the compressed data files to the cache, then reads them back to compare the loading times
+void Resource::rebuildCache() {
+	static const struct {
+		const char *ext;
+		int type;
+	} types[] = {
+		{ "CT", OT_CT },
+		{ "OBC", OT_OBC },
+		{ "SGD", OT_SGD },
+		{ "SPM", OT_SPM },
+		{ "CMP", OT_CMP },
+		{ 0, 0 }
+	};
+	double totalMs[2] = { 0., 0. };
+	int count = 0;
+	for (int i = 0; i < _fs->getFilesCount(); ++i) {
+		const char *fileName = _fs->getFileName(i);
+		const char *ext = strrchr(fileName, '.');
+		if (!ext) {
+			continue;
+		}
+		int type = -1;
+		for (int j = 0; types[j].ext; ++j) {
+			if (strcasecmp(ext + 1, types[j].ext) == 0) {
+				type = types[j].type;
+				break;
+			}
+		}
+		if (type == -1) {
+			continue;
+		}
+		char objName[32];
+		snprintf(objName, sizeof(objName), "%.*s", (int)(ext - fileName), fileName);
+		double ms[2];
+		for (int pass = 0; pass < 2; ++pass) {
+			_rebuildCache = (pass == 0);
+			const uint64_t start = SDL_GetPerformanceCounter();
+			if (type == OT_CMP && strcasecmp(fileName, "present.cmp") == 0) {
+				load_CMP_menu(fileName);
+			} else {
+				load(objName, type, ext + 1);
+			}
+			ms[pass] = (SDL_GetPerformanceCounter() - start) * 1000. / SDL_GetPerformanceFrequency();
+			totalMs[pass] += ms[pass];
+			switch (type) {
+			case OT_OBC:
+				free_OBJ();
+				break;
+			case OT_SGD:
+				free(_sgd);
+				_sgd = 0;
+				break;
+			case OT_SPM:
+				freeData(_spr1);
+				_spr1 = 0;
+				break;
+			case OT_CMP:
+				unload(OT_CMP);
+				break;
+			}
+		}
+		debug(DBG_INFO, "%s: unpacked in %.2f ms, read from the cache in %.2f ms", fileName, ms[0], ms[1]);
+		++count;
+	}
+	_rebuildCache = false;
+	debug(DBG_INFO, "Cached %d files in '%s', unpacked in %.1f ms, read from the cache in %.1f ms", count, _cachePath, totalMs[0], totalMs[1]);
+}
+
 void Resource::load(const char *objName, int objType, const char *ext) {
 	debug(DBG_RES, "Resource::load('%s', %d)", objName, objType);
 	LoadStub loadStub = 0;
@@ -610,7 +847,7 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 		snprintf(_entryName, sizeof(_entryName), "%s.%s", objName, ext);
 	}
 	File f;
-	if (f.open(_entryName, "rb", _fs)) {
+	if (f.open(_entryName, isMappedType(objType) ? "mrb" : "rb", _fs)) {
 		assert(loadStub);
 		(this->*loadStub)(&f);
 		if (f.ioErr()) {
@@ -638,7 +875,7 @@ void Resource::load_CT(File *pf) {
 		error("Unable to allocate CT buffer");
 	} else {
 		pf->read(tmp, len);
-		if (!bytekiller_unpack((uint8_t *)_ctData, sizeof(_ctData), tmp, len)) {
+		if (!unpackCached(0, (uint8_t *)_ctData, sizeof(_ctData), tmp, len)) {
 			error("Bad CRC for collision data");
 		}
 		free(tmp);
@@ -658,12 +895,10 @@ void Resource::load_FNT(File *f) {
 
 void Resource::load_MBK(File *f) {
 	debug(DBG_RES, "Resource::load_MBK()");
-	int len = f->size();
-	_mbk = (uint8_t *)malloc(len);
+	_mbkSize = f->size();
+	_mbk = readData(f, 0, _mbkSize);
 	if (!_mbk) {
 		error("Unable to allocate MBK buffer");
-	} else {
-		f->read(_mbk, len);
 	}
 }
 
@@ -685,13 +920,9 @@ void Resource::load_ICN(File *f) {
 
 void Resource::load_SPR(File *f) {
 	debug(DBG_RES, "Resource::load_SPR()");
-	int len = f->size() - 12;
-	_spr1 = (uint8_t *)malloc(len);
+	_spr1 = readData(f, 12, f->size() - 12);
 	if (!_spr1) {
 		error("Unable to allocate SPR1 buffer");
-	} else {
-		f->seek(12);
-		f->read(_spr1, len);
 	}
 }
 
@@ -710,12 +941,11 @@ void Resource::load_RP(File *f) {
 
 void Resource::load_SPC(File *f) {
 	debug(DBG_RES, "Resource::load_SPC()");
-	int len = f->size();
-	_spc = (uint8_t *)malloc(len);
+	freeData(_spc);
+	_spc = readData(f, 0, f->size());
 	if (!_spc) {
 		error("Unable to allocate SPC buffer");
 	} else {
-		f->read(_spc, len);
 		_numSpc = READ_BE_UINT16(_spc) / 2;
 	}
 }
@@ -733,12 +963,9 @@ void Resource::load_PAL(File *f) {
 
 void Resource::load_MAP(File *f) {
 	debug(DBG_RES, "Resource::load_MAP()");
-	int len = f->size();
-	_map = (uint8_t *)malloc(len);
+	_map = readData(f, 0, f->size());
 	if (!_map) {
 		error("Unable to allocate MAP buffer");
-	} else {
-		f->read(_map, len);
 	}
 }
 
@@ -838,7 +1065,7 @@ void Resource::load_OBC(File *f) {
 	}
 	f->seek(4);
 	f->read(packedData, packedSize);
-	if (!bytekiller_unpack(tmp, unpackedSize, packedData, packedSize)) {
+	if (!unpackCached(0, tmp, unpackedSize, packedData, packedSize)) {
 		error("Bad CRC for compressed object data");
 	}
 	free(packedData);
@@ -998,31 +1225,25 @@ void Resource::load_TBN(File *f) {
 
 void Resource::load_CMD(File *pf) {
 	debug(DBG_RES, "Resource::load_CMD()");
-	free(_cmd);
-	int len = pf->size();
-	_cmd = (uint8_t *)malloc(len);
+	freeData(_cmd);
+	_cmd = readData(pf, 0, pf->size());
 	if (!_cmd) {
 		error("Unable to allocate CMD buffer");
-	} else {
-		pf->read(_cmd, len);
 	}
 }
 
 void Resource::load_POL(File *pf) {
 	debug(DBG_RES, "Resource::load_POL()");
-	free(_pol);
-	int len = pf->size();
-	_pol = (uint8_t *)malloc(len);
+	freeData(_pol);
+	_pol = readData(pf, 0, pf->size());
 	if (!_pol) {
 		error("Unable to allocate POL buffer");
-	} else {
-		pf->read(_pol, len);
 	}
 }
 
 void Resource::load_CMP(File *pf) {
-	free(_pol);
-	free(_cmd);
+	freeData(_pol);
+	freeData(_cmd);
 	int len = pf->size();
 	uint8_t *tmp = (uint8_t *)malloc(len);
 	if (!tmp) {
@@ -1051,7 +1272,7 @@ void Resource::load_CMP(File *pf) {
 	}
 	if (data[0].packedSize == data[0].size) {
 		memcpy(_pol, tmp + data[0].offset, data[0].packedSize);
-	} else if (!bytekiller_unpack(_pol, data[0].size, tmp + data[0].offset, data[0].packedSize)) {
+	} else if (!unpackCached(0, _pol, data[0].size, tmp + data[0].offset, data[0].packedSize)) {
 		error("Bad CRC for cutscene polygon data");
 	}
 	_cmd = (uint8_t *)malloc(data[1].size);
@@ -1060,7 +1281,7 @@ void Resource::load_CMP(File *pf) {
 	}
 	if (data[1].packedSize == data[1].size) {
 		memcpy(_cmd, tmp + data[1].offset, data[1].packedSize);
-	} else if (!bytekiller_unpack(_cmd, data[1].size, tmp + data[1].offset, data[1].packedSize)) {
+	} else if (!unpackCached(1, _cmd, data[1].size, tmp + data[1].offset, data[1].packedSize)) {
 		error("Bad CRC for cutscene command data");
 	}
 	free(tmp);
@@ -1110,10 +1331,7 @@ void Resource::load_VCE(int num, int segment, uint8_t **buf, uint32_t *bufSize)
 }
 
 void Resource::load_SPL(File *f) {
-	for (int i = 0; i < _numSfx; ++i) {
-		free(_sfxList[i].data);
-	}
-	free(_sfxList);
+	freeSfx();
 	_numSfx = NUM_SFXS;
 	_sfxList = (SoundFx *)calloc(_numSfx, sizeof(SoundFx));
 	if (!_sfxList) {
@@ -1145,12 +1363,10 @@ void Resource::load_SPL(File *f) {
 }
 
 void Resource::load_LEV(File *f) {
-	const int len = f->size();
-	_lev = (uint8_t *)malloc(len);
+	freeData(_lev);
+	_lev = readData(f, 0, f->size());
 	if (!_lev) {
 		error("Unable to allocate LEV buffer");
-	} else {
-		f->read(_lev, len);
 	}
 }
 
@@ -1179,7 +1395,7 @@ void Resource::load_SGD(File *f) {
 	if (!_sgd) {
 		error("Unable to allocate SGD buffer");
 	}
-	if (!bytekiller_unpack(_sgd, size, tmp, len)) {
+	if (!unpackCached(0, _sgd, size, tmp, len)) {
 		error("Bad CRC for SGD data");
 	}
 	free(tmp);
@@ -1192,6 +1408,7 @@ void Resource::load_BNQ(File *f) {
 		error("Unable to allocate BNQ buffer");
 	} else {
 		f->read(_bnq, len);
+		_bnqSize = len;
 	}
 }
 
@@ -1211,12 +1428,12 @@ void Resource::load_SPM(File *f) {
 		if (!_spr1) {
 			error("Unable to allocate SPR1 buffer");
 		}
-		if (!bytekiller_unpack(_spr1, size, tmp, len)) {
+		if (!unpackCached(0, _spr1, size, tmp, len)) {
 			error("Bad CRC for SPM data");
 		}
 	} else {
 		assert(size <= sizeof(_sprm));
-		if (!bytekiller_unpack(_sprm, sizeof(_sprm), tmp, len)) {
+		if (!unpackCached(0, _sprm, sizeof(_sprm), tmp, len)) {
 			error("Bad CRC for SPM data");
 		}
 	}
@@ -1232,12 +1449,14 @@ void Resource::load_SPM(File *f) {
 }
 
 void Resource::clearBankData() {
+	for (int i = 0; i < _bankBuffersCount; ++i) {
+		_bankBuffersIndex[_bankBuffers[i].entryNum] = -1;
+	}
 	_bankBuffersCount = 0;
-	_bankDataHead = _bankData;
 }
 
-int Resource::getBankDataSize(uint16_t num) {
-	int len = READ_BE_UINT16(_mbk + num * 6 + 4);
+int Resource::getBankDataSize(const uint8_t *mbk, uint16_t num) const {
+	int len = READ_BE_UINT16(mbk + num * 6 + 4);
 	switch (_type) {
 	case kResourceTypeAmiga:
 		if (len & 0x8000) {
@@ -1246,7 +1465,7 @@ int Resource::getBankDataSize(uint16_t num) {
 		break;
 	case kResourceTypeDOS:
 		if (len & 0x8000) {
-			if (_mbk == _bnq) { // demo .bnq use signed int
+			if (mbk == _bnq) { // demo .bnq use signed int
 				len = -(int16_t)len;
 				break;
 			}
@@ -1257,43 +1476,213 @@ int Resource::getBankDataSize(uint16_t num) {
 	return len * 32;
 }
 
+// the unpacked entries are looked up by number, the pointer is valid until the next loadBankData() call
 uint8_t *Resource::findBankData(uint16_t num) {
-	for (int i = 0; i < _bankBuffersCount; ++i) {
-		if (_bankBuffers[i].entryNum == num) {
-			return _bankBuffers[i].ptr;
+	assert(num < NUM_BANK_BUFFERS);
+	if (_mbkArena.offsets[num] >= 0) {
+		++_bankPredecodedHits;
+		return _mbkArena.data + _mbkArena.offsets[num];
+	}
+	const int slot = _bankBuffersIndex[num];
+	if (slot < 0) {
+		++_bankMisses;
+		return 0;
+	}
+	++_bankHits;
+	_bankBuffers[slot].lastUse = ++_bankUseCounter;
+	return _bankData + _bankBuffers[slot].offset * 32;
+}
+
+uint8_t *Resource::loadBankData(uint16_t num) {
+	assert(num < NUM_BANK_BUFFERS && _bankBuffersIndex[num] < 0);
+	const int size = getBankDataSize(num);
+	const int offset = allocBankData(size / 32);
+	BankSlot *slot = &_bankBuffers[_bankBuffersCount];
+	slot->entryNum = num;
+	slot->offset = offset;
+	slot->size = size / 32;
+	slot->lastUse = ++_bankUseCounter;
+	_bankBuffersIndex[num] = _bankBuffersCount;
+	++_bankBuffersCount;
+	uint8_t *bankData = _bankData + offset * 32;
+	unpackBankData(_mbk, num, bankData, size);
+	_bankFrameBytes += size;
+	return bankData;
+}
+
+// first fit in the gaps between the entries, evicting the least recently used ones until the size fits
+int Resource::allocBankData(int units) {
+	assert(units <= _bankDataUnits);
+	while (1) {
+		if (_bankBuffersCount < NUM_BANK_BUFFERS) {
+			int sorted[NUM_BANK_BUFFERS];
+			for (int i = 0; i < _bankBuffersCount; ++i) {
+				int j = i;
+				for (; j > 0 && _bankBuffers[sorted[j - 1]].offset > _bankBuffers[i].offset; --j) {
+					sorted[j] = sorted[j - 1];
+				}
+				sorted[j] = i;
+			}
+			int pos = 0;
+			for (int i = 0; i < _bankBuffersCount; ++i) {
+				const BankSlot *slot = &_bankBuffers[sorted[i]];
+				if ((int)slot->offset - pos >= units) {
+					return pos;
+				}
+				pos = slot->offset + slot->size;
+			}
+			if (_bankDataUnits - pos >= units) {
+				return pos;
+			}
+		}
+		int lru = 0;
+		for (int i = 1; i < _bankBuffersCount; ++i) {
+			if (_bankBuffers[i].lastUse < _bankBuffers[lru].lastUse) {
+				lru = i;
+			}
 		}
+		freeBankSlot(lru);
 	}
-	return 0;
 }
 
-uint8_t *Resource::loadBankData(uint16_t num) {
-	const uint8_t *ptr = _mbk + num * 6;
+void Resource::freeBankSlot(int slot) {
+	_bankBuffersIndex[_bankBuffers[slot].entryNum] = -1;
+	--_bankBuffersCount;
+	if (slot != _bankBuffersCount) {
+		_bankBuffers[slot] = _bankBuffers[_bankBuffersCount];
+		_bankBuffersIndex[_bankBuffers[slot].entryNum] = slot;
+	}
+}
+
+void Resource::endBankDataFrame() {
+	if (_bankFrameBytes != 0) {
+		debug(DBG_RES, "Unpacked %d bytes of bank data in the frame", _bankFrameBytes);
+		_bankPeakFrameBytes = MAX(_bankPeakFrameBytes, _bankFrameBytes);
+		_bankTotalBytes += _bankFrameBytes;
+		_bankFrameBytes = 0;
+	}
+}
+
+void Resource::dumpBankDataStats() {
+	if (_bankPredecodedHits != 0) {
+		debug(DBG_INFO, "Bank data: %d lookups of predecoded entries", _bankPredecodedHits);
+	}
+	const uint32_t total = _bankHits + _bankMisses;
+	if (total != 0) {
+		debug(DBG_INFO, "Bank cache: %d hits, %d misses (%.1f%% hit rate), %d KB unpacked, at most %d bytes in a frame (%d KB arena)", _bankHits, _bankMisses, _bankHits * 100. / total, _bankTotalBytes / 1024, _bankPeakFrameBytes, _bankDataUnits * 32 / 1024);
+	}
+}
+
+// does not modify the resource state, the room decoders call it from worker threads
+void Resource::unpackBankData(const uint8_t *mbk, uint16_t num, uint8_t *dst, int dstSize) const {
+	const uint8_t *ptr = mbk + num * 6;
 	int dataOffset = READ_BE_UINT32(ptr);
 	if (_type == kResourceTypeDOS) {
 		// first byte of the data buffer corresponds
 		// to the total count of entries
 		dataOffset &= 0xFFFF;
 	}
-	const int size = getBankDataSize(num);
-	const int avail = _bankDataTail - _bankDataHead;
-	if (avail < size) {
-		clearBankData();
-	}
-	assert(_bankDataHead + size <= _bankDataTail);
-	assert(_bankBuffersCount < (int)ARRAYSIZE(_bankBuffers));
-	_bankBuffers[_bankBuffersCount].entryNum = num;
-	_bankBuffers[_bankBuffersCount].ptr = _bankDataHead;
-	const uint8_t *data = _mbk + dataOffset;
+	const int size = getBankDataSize(mbk, num);
+	assert(size <= dstSize);
+	const uint8_t *data = mbk + dataOffset;
 	if (READ_BE_UINT16(ptr + 4) & 0x8000) {
-		memcpy(_bankDataHead, data, size);
+		memcpy(dst, data, size);
 	} else {
 		assert(dataOffset > 4);
 		assert(size == (int)READ_BE_UINT32(data - 4));
-		if (!bytekiller_unpack(_bankDataHead, _bankDataTail - _bankDataHead, data, 0)) {
+		if (!bytekiller_unpack(dst, dstSize, data, 0)) {
 			error("Bad CRC for bank data %d", num);
 		}
 	}
-	uint8_t *bankData = _bankDataHead;
-	_bankDataHead += size;
-	return bankData;
+}
+
+// the table has no entries count on Amiga, the ones referenced by the level are checked against the file size
+bool Resource::isValidBankEntry(const uint8_t *mbk, uint32_t mbkSize, uint16_t num) const {
+	if ((num + 1) * 6 > (int)mbkSize) {
+		return false;
+	}
+	const uint8_t *ptr = mbk + num * 6;
+	uint32_t dataOffset = READ_BE_UINT32(ptr);
+	if (_type == kResourceTypeDOS) {
+		dataOffset &= 0xFFFF;
+	}
+	const int size = getBankDataSize(mbk, num);
+	if (size == 0 || size > kBankDataSize || dataOffset >= mbkSize) {
+		return false;
+	}
+	if (READ_BE_UINT16(ptr + 4) & 0x8000) {
+		return dataOffset + size <= mbkSize;
+	}
+	return dataOffset > 4 && size == (int)READ_BE_UINT32(mbk + dataOffset - 4);
+}
+
+// unpacks the entries of the level once, the draw and room decoding code then only read from the arenas
+void Resource::predecodeBanks() {
+	freeBankArenas();
+	bool entries[NUM_BANK_BUFFERS];
+	memset(entries, 0, sizeof(entries));
+	for (int i = 0; i < ARRAYSIZE(_rp); ++i) {
+		entries[_rp[i]] = true;
+	}
+	if (_type == kResourceTypeDOS) {
+		for (int i = 0; i < _mbk[0]; ++i) {
+			entries[i] = true;
+		}
+	}
+	predecodeBankArena(&_mbkArena, _mbk, _mbkSize, entries);
+	if (_bnq) {
+		memset(entries, 0, sizeof(entries));
+		for (int i = 0; i < _bnq[0]; ++i) {
+			entries[i] = true;
+		}
+		predecodeBankArena(&_bnqArena, _bnq, _bnqSize, entries);
+	}
+	debug(DBG_INFO, "Predecoded bank data %d KB (MBK %d KB, BNQ %d KB)", (_mbkArena.size + _bnqArena.size) / 1024, _mbkArena.size / 1024, _bnqArena.size / 1024);
+}
+
+void Resource::predecodeBankArena(BankArena *arena, const uint8_t *mbk, uint32_t mbkSize, const bool *entries) {
+	uint32_t size = 0;
+	int count = 0;
+	for (int i = 0; i < NUM_BANK_BUFFERS; ++i) {
+		if (entries[i] && isValidBankEntry(mbk, mbkSize, i)) {
+			arena->offsets[i] = size;
+			size += getBankDataSize(mbk, i);
+			++count;
+		}
+	}
+	if (size == 0) {
+		return;
+	}
+	arena->data = (uint8_t *)malloc(size);
+	if (!arena->data) {
+		error("Unable to allocate bank data arena (%d bytes)", size);
+	}
+	arena->size = size;
+	for (int i = 0; i < NUM_BANK_BUFFERS; ++i) {
+		if (arena->offsets[i] >= 0) {
+			const int len = getBankDataSize(mbk, i);
+			unpackBankData(mbk, i, arena->data + arena->offsets[i], len);
+		}
+	}
+	debug(DBG_RES, "Unpacked %d bank entries, %d bytes", count, size);
+}
+
+void Resource::freeBankArenas() {
+	free(_mbkArena.data);
+	_mbkArena.data = 0;
+	_mbkArena.size = 0;
+	memset(_mbkArena.offsets, 0xFF, sizeof(_mbkArena.offsets));
+	free(_bnqArena.data);
+	_bnqArena.data = 0;
+	_bnqArena.size = 0;
+	memset(_bnqArena.offsets, 0xFF, sizeof(_bnqArena.offsets));
+}
+
+// read only, safe to call from the room decoding threads
+const uint8_t *Resource::findPredecodedBankData(const uint8_t *mbk, uint16_t num) const {
+	const BankArena *arena = (mbk == _bnq) ? &_bnqArena : &_mbkArena;
+	if (num < NUM_BANK_BUFFERS && arena->offsets[num] >= 0) {
+		return arena->data + arena->offsets[num];
+	}
+	return 0;
 }
@@ -103,7 +103,7 @@ struct Resource {
 
 	enum {
 		NUM_SFXS = 66,
-		NUM_BANK_BUFFERS = 50,
+		NUM_BANK_BUFFERS = 256,
 		NUM_CUTSCENE_TEXTS = 117,
 		NUM_SPRITES = 1287
 	};
@@ -111,7 +111,8 @@ struct Resource {
 	enum {
 		kPaulaFreq = 3546897,
 		kClutSize = 1024,
-		kScratchBufferSize = 320 * 224 + 1024
+		kScratchBufferSize = 320 * 224 + 1024,
+		kBankDataSize = 0x7000
 	};
 
 	static const uint16_t _voicesOffsetsTable[];
@@ -121,6 +122,8 @@ struct Resource {
 	static const uint16_t _gameSavedSoundLen;
 
 	FileSystem *_fs;
+	const char *_cachePath; // directory of the unpacked data files, 0 to always unpack
+	bool _rebuildCache;
 	ResourceType _type;
 	Language _lang;
 	bool _isDemo;
@@ -129,6 +132,7 @@ struct Resource {
 	char _entryName[32];
 	uint8_t *_fnt;
 	uint8_t *_mbk;
+	uint32_t _mbkSize;
 	uint8_t *_icn;
 	int _icnLen;
 	uint8_t *_tab;
@@ -149,6 +153,7 @@ struct Resource {
 	int _levNum;
 	uint8_t *_sgd;
 	uint8_t *_bnq;
+	uint32_t _bnqSize;
 	uint16_t _numObjectNodes;
 	ObjectNode *_objectNodesMap[255];
 	uint8_t *_scratchBuffer;
@@ -162,10 +167,14 @@ struct Resource {
 	const char **_textsTable;
 	const uint8_t *_stringsTable;
 	uint8_t *_bankData;
-	uint8_t *_bankDataHead;
-	uint8_t *_bankDataTail;
+	int _bankDataUnits;
 	BankSlot _bankBuffers[NUM_BANK_BUFFERS];
 	int _bankBuffersCount;
+	int16_t _bankBuffersIndex[NUM_BANK_BUFFERS]; // by entry number
+	uint32_t _bankUseCounter;
+	uint32_t _bankHits, _bankMisses, _bankPredecodedHits;
+	uint32_t _bankFrameBytes, _bankPeakFrameBytes, _bankTotalBytes;
+	BankArena _mbkArena, _bnqArena;
 	uint8_t *_dem;
 	int _demLen;
 	int _clutSize;
@@ -189,9 +198,12 @@ struct Resource {
 	bool fileExists(const char *filename);
 
 	void clearLevelRes();
+	void swapLevelRes(Resource *res);
 	void load_DEM(const char *filename);
 	void load_FIB(const char *fileName);
 	void load_SPL_demo();
+	void resampleSfx(int outputRate);
+	void freeSfx();
 	void load_MAP_menu(const char *fileName, uint8_t *dstPtr);
 	void load_PAL_menu(const char *fileName, uint8_t *dstPtr);
 	void load_CMP_menu(const char *fileName);
@@ -201,6 +213,10 @@ struct Resource {
 	void load_TEXT();
 	void free_TEXT();
 	void unload(int objType);
+	static uint8_t *readData(File *f, uint32_t offset, uint32_t len);
+	bool unpackCached(int part, uint8_t *dst, int dstSize, const uint8_t *src, int srcSize);
+	void rebuildCache();
+	static void freeData(uint8_t *p);
 	void load(const char *objName, int objType, const char *ext = 0);
 	void load_CT(File *pf);
 	void load_FNT(File *pf);
@@ -283,9 +299,20 @@ struct Resource {
 		return (num >= 0 && num < LocaleData::LI_NUM) ? _textsTable[num] : "";
 	}
 	void clearBankData();
-	int getBankDataSize(uint16_t num);
+	int getBankDataSize(uint16_t num) const { return getBankDataSize(_mbk, num); }
+	int getBankDataSize(const uint8_t *mbk, uint16_t num) const;
 	uint8_t *findBankData(uint16_t num);
 	uint8_t *loadBankData(uint16_t num);
+	int allocBankData(int units);
+	void freeBankSlot(int slot);
+	void endBankDataFrame();
+	void dumpBankDataStats();
+	void unpackBankData(const uint8_t *mbk, uint16_t num, uint8_t *dst, int dstSize) const;
+	bool isValidBankEntry(const uint8_t *mbk, uint32_t mbkSize, uint16_t num) const;
+	void predecodeBanks();
+	void predecodeBankArena(BankArena *arena, const uint8_t *mbk, uint32_t mbkSize, const bool *entries);
+	void freeBankArenas();
+	const uint8_t *findPredecodedBankData(const uint8_t *mbk, uint16_t num) const;
 };
 
 #endif // RESOURCE_H__
@@ -4,6 +4,8 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <math.h>
+#include "mix_kernels.h"
 #include "mixer.h"
 #include "sfx_player.h"
 #include "util.h"
@@ -12,23 +14,53 @@
 // use one third of the volume for master (for comparison, modplug uses a master volume of 128, max 512)
 static const int kMasterVolume = 64 * 3;
 
-#define NZEROS 2
-#define NPOLES 2
-static float bw_xf[NZEROS+1], bw_yf[NPOLES+1];
-static const float GAIN = 7.655158005e+00;
+// corner frequency of the original filter coefficients, designed for 22050 Hz (gain 7.655, poles -0.2729, 0.7504)
+static const int kFilterCutoff = 3300;
 
-static void butterworth(int16_t *p, int len) {
+void ButterworthFilter::init(int cutoff, int rate) {
+	// bilinear transform of the analog prototype
+	const double k = tan(M_PI * MIN(cutoff, rate * 45 / 100) / rate);
+	const double norm = 1. / (1. + M_SQRT2 * k + k * k);
+	const double b0 = k * k * norm;
+	const double a1 = 2. * (1. - k * k) * norm;
+	const double a2 = -(1. - M_SQRT2 * k + k * k) * norm;
+	const double scale = 1 << COEF_BITS;
+	_b0 = (int)floor(b0 * scale + .5);
+	_b1 = 2 * _b0;
+	_b2 = _b0;
+	_a1 = (int)floor(a1 * scale + .5);
+	_a2 = (int)floor(a2 * scale + .5);
+	reset();
+}
+
+void ButterworthFilter::reset() {
+	_x1 = _x2 = 0;
+	_y1 = _y2 = 0;
+}
+
+void ButterworthFilter::process(int16_t *p, int len) {
+	// the history is kept in locals, the recursion prevents processing several samples at once
+	int x1 = _x1, x2 = _x2;
+	int y1 = _y1, y2 = _y2;
 	for (int i = 0; i < len; ++i) {
-		bw_xf[0] = bw_xf[1]; bw_xf[1] = bw_xf[2];
-		bw_xf[2] = p[i] / GAIN;
-		bw_yf[0] = bw_yf[1]; bw_yf[1] = bw_yf[2];
-		bw_yf[2] = (bw_xf[0] + bw_xf[2]) + 2 * bw_xf[1] + (-0.2729352339 * bw_yf[0]) + (0.7504117278 * bw_yf[1]);
-		p[i] = (int16_t)CLIP(bw_yf[2], -32768.f, 32767.f);
-        }
+		const int x0 = p[i];
+		const int acc = (_b0 * x0 + _b1 * x1 + _b2 * x2) * (1 << STATE_BITS) + _a1 * y1 + _a2 * y2;
+		const int y0 = acc >> COEF_BITS;
+		x2 = x1;
+		x1 = x0;
+		y2 = y1;
+		y1 = y0;
+		p[i] = CLIP(y0 >> STATE_BITS, -32768, 32767);
+	}
+	_x1 = x1;
+	_x2 = x2;
+	_y1 = y1;
+	_y2 = y2;
 }
 
 SfxPlayer::SfxPlayer(Mixer *mixer)
 	: _mod(0), _playing(false), _mix(mixer) {
+	_filter.init(kFilterCutoff, 22050);
 }
 
 void SfxPlayer::play(uint8_t num) {
@@ -46,10 +78,9 @@ void SfxPlayer::play(uint8_t num) {
 		_modData = _mod->moduleData + 0x22;
 		memset(_samples, 0, sizeof(_samples));
 		_samplesLeft = 0;
-		_mix->setPremixHook(mixCallback, this);
+		_filter.init(kFilterCutoff, _mix->getSampleRate());
 		_playing = true;
-        memset(bw_xf, 0, sizeof(bw_xf));
-        memset(bw_yf, 0, sizeof(bw_yf));
+		_mix->setPremixHook(mixCallback, this);
 	}
 }
 
@@ -118,42 +149,47 @@ void SfxPlayer::handleTick() {
 }
 
 void SfxPlayer::mixSamples(int16_t *buf, int samplesLen) {
-	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		SampleInfo *si = &_samples[i];
-		if (si->data) {
-			int16_t *mixbuf = buf;
-			int len = si->len << FRAC_BITS;
-			int loopLen = si->loopLen << FRAC_BITS;
-			int loopPos = si->loopPos << FRAC_BITS;
-			int deltaPos = (si->freq << FRAC_BITS) / _mix->getSampleRate();
-			int curLen = samplesLen;
-			int pos = si->pos;
-			while (curLen != 0) {
-				int count;
-				if (loopLen > (2 << FRAC_BITS)) {
-					assert(si->loopPos + si->loopLen <= si->len);
-					if (pos >= loopPos + loopLen) {
-						pos -= loopLen;
-					}
-					count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
-					curLen -= count;
-				} else {
-					if (pos >= len) {
-						count = 0;
+	int32_t acc[kMixBlockSize];
+	while (samplesLen != 0) {
+		const int blockLen = MIN(samplesLen, (int)kMixBlockSize);
+		memset(acc, 0, sizeof(int32_t) * blockLen);
+		for (int i = 0; i < NUM_CHANNELS; ++i) {
+			SampleInfo *si = &_samples[i];
+			if (si->data) {
+				int32_t *mixbuf = acc;
+				int len = si->len << FRAC_BITS;
+				int loopLen = si->loopLen << FRAC_BITS;
+				int loopPos = si->loopPos << FRAC_BITS;
+				int deltaPos = (si->freq << FRAC_BITS) / _mix->getSampleRate();
+				const int gain = mixGain(si->vol, kMasterVolume);
+				int curLen = blockLen;
+				int pos = si->pos;
+				while (curLen != 0) {
+					int count;
+					if (loopLen > (2 << FRAC_BITS)) {
+						assert(si->loopPos + si->loopLen <= si->len);
+						if (pos >= loopPos + loopLen) {
+							pos -= loopLen;
+						}
+						count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
+						curLen -= count;
 					} else {
-						count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
+						if (pos >= len) {
+							count = 0;
+						} else {
+							count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
+						}
+						curLen = 0;
 					}
-					curLen = 0;
-				}
-				while (count--) {
-					const int out = si->getPCM(pos >> FRAC_BITS) * si->vol / kMasterVolume;
-					*mixbuf = ADDC_S16(*mixbuf, S8_to_S16(out));
-					++mixbuf;
-					pos += deltaPos;
+					pos = mixS8(mixbuf, si->data, si->len, pos, deltaPos, count, gain);
+					mixbuf += count;
 				}
+				si->pos = pos;
 			}
-			si->pos = pos;
 		}
+		mixClipS16(buf, acc, blockLen);
+		buf += blockLen;
+		samplesLen -= blockLen;
 	}
 }
 
@@ -173,7 +209,7 @@ bool SfxPlayer::mix(int16_t *buf, int len) {
 			_samplesLeft -= count;
 			len -= count;
 			mixSamples(buf, count);
-			butterworth(buf, count);
+			_filter.process(buf, count);
 			buf += count;
 		}
 	}
@@ -11,6 +11,21 @@
 
 struct Mixer;
 
+// second order low-pass, fixed point direct form I
+struct ButterworthFilter {
+	enum {
+		COEF_BITS = 12,
+		STATE_BITS = 2 // extra precision of the output history
+	};
+
+	int _b0, _b1, _b2, _a1, _a2;
+	int _x1, _x2, _y1, _y2;
+
+	void init(int cutoff, int rate);
+	void reset();
+	void process(int16_t *p, int len);
+};
+
 struct SfxPlayer {
 	enum {
 		NUM_SAMPLES = 5,
@@ -73,6 +88,7 @@ struct SfxPlayer {
 	uint16_t _orderDelay;
 	const uint8_t *_modData;
 	SampleInfo _samples[NUM_CHANNELS];
+	ButterworthFilter _filter;
 	Mixer *_mix;
 
 	SfxPlayer(Mixer *mixer);
@@ -35,6 +35,7 @@ struct PlayerInput {
 	bool load;
 	int stateSlot;
 	bool rewind;
+	bool dumpStats;
 
 	uint8_t dbgMask;
 	bool quit;
@@ -64,6 +65,8 @@ struct SystemStub {
 	virtual void processEvents() = 0;
 	virtual void sleep(int duration) = 0;
 	virtual uint32_t getTimeStamp() = 0;
+	virtual uint64_t getTimeStampUs() = 0;
+	virtual void waitUntil(uint64_t timeStampUs) = 0;
 
 	virtual void startAudio(AudioCallback callback, void *param) = 0;
 	virtual void stopAudio() = 0;
@@ -84,5 +87,6 @@ struct LockAudioStack {
 };
 
 extern SystemStub *SystemStub_SDL_create();
+extern SystemStub *SystemStub_Null_create(int framesLimit, const char *wavPath);
 
 #endif // SYSTEMSTUB_H__
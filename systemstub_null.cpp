@@ -0,0 +1,268 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <SDL.h>
+#include "systemstub.h"
+#include "util.h"
+
+// no window, no GL context, no audio device : time only advances when the engine sleeps
+struct SystemStub_Null : SystemStub {
+	int _screenW, _screenH;
+	Color _palette[256];
+	uint64_t _timeStampUs;
+	uint32_t _framesCount;
+	uint32_t _framesLimit;
+	uint64_t _startCounter;
+	int16_t *_audioBuf;
+	uint64_t _audioFrac;
+	int _audioPending;
+	int _audioHz;
+	int _audioBufSize;
+	void (*_audioCbProc)(void *, int16_t *, int);
+	void *_audioCbData;
+	const char *_wavPath;
+	FILE *_wavFile;
+	uint32_t _wavSamplesCount;
+
+	SystemStub_Null(int framesLimit, const char *wavPath)
+		: _framesLimit(framesLimit), _wavPath(wavPath) {
+	}
+	virtual ~SystemStub_Null() {}
+	virtual void init(const char *title, int w, int h, bool fullscreen);
+	virtual void destroy();
+	virtual void setScreenSize(int w, int h);
+	virtual void setPalette(const uint8_t *pal, int n);
+	virtual void getPalette(uint8_t *pal, int n);
+	virtual void setPaletteEntry(int i, const Color *c);
+	virtual void getPaletteEntry(int i, Color *c);
+	virtual void setOverscanColor(int i);
+	virtual void copyRect(int x, int y, int w, int h, const uint8_t *buf, int pitch);
+	virtual void copyRectRgb24(int x, int y, int w, int h, const uint8_t *rgb);
+	virtual void fadeScreen();
+	virtual void updateScreen(int shakeOffset);
+	virtual void processEvents();
+	virtual void sleep(int duration);
+	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampUs();
+	virtual void waitUntil(uint64_t timeStampUs);
+	virtual void startAudio(AudioCallback callback, void *param);
+	virtual void stopAudio();
+	virtual uint32_t getOutputSampleRate();
+	virtual void lockAudio();
+	virtual void unlockAudio();
+
+	void advanceTime(uint64_t duration);
+	void writeWavHeader();
+	void writeWavSamples(const int16_t *samples, int count);
+};
+
+SystemStub *SystemStub_Null_create(int framesLimit, const char *wavPath) {
+	return new SystemStub_Null(framesLimit, wavPath);
+}
+
+void SystemStub_Null::init(const char *title, int w, int h, bool fullscreen) {
+	memset(&_pi, 0, sizeof(_pi));
+	memset(_palette, 0, sizeof(_palette));
+	_screenW = w;
+	_screenH = h;
+	_timeStampUs = 0;
+	_framesCount = 0;
+	_startCounter = SDL_GetPerformanceCounter();
+	_audioBuf = 0;
+	_audioFrac = 0;
+	_audioPending = 0;
+	_audioHz = g_options.audio_sample_rate;
+	_audioBufSize = MAX(g_options.audio_buffer_size, 1);
+	_audioCbProc = 0;
+	_audioCbData = 0;
+	_wavFile = 0;
+	_wavSamplesCount = 0;
+}
+
+void SystemStub_Null::destroy() {
+	stopAudio();
+	const double elapsed = (SDL_GetPerformanceCounter() - _startCounter) / (double)SDL_GetPerformanceFrequency();
+	const double simulated = _timeStampUs / 1000000.;
+	debug(DBG_INFO, "Headless: %d frames, %.1f simulated seconds in %.2f seconds (%.1f fps)", _framesCount, simulated, elapsed, (elapsed > 0.) ? _framesCount / elapsed : 0.);
+}
+
+void SystemStub_Null::setScreenSize(int w, int h) {
+	_screenW = w;
+	_screenH = h;
+}
+
+void SystemStub_Null::setPalette(const uint8_t *pal, int n) {
+	assert(n <= 256);
+	for (int i = 0; i < n; ++i) {
+		_palette[i].r = pal[0];
+		_palette[i].g = pal[1];
+		_palette[i].b = pal[2];
+		pal += 3;
+	}
+}
+
+void SystemStub_Null::getPalette(uint8_t *pal, int n) {
+	assert(n <= 256);
+	for (int i = 0; i < n; ++i) {
+		pal[0] = _palette[i].r;
+		pal[1] = _palette[i].g;
+		pal[2] = _palette[i].b;
+		pal += 3;
+	}
+}
+
+void SystemStub_Null::setPaletteEntry(int i, const Color *c) {
+	_palette[i] = *c;
+}
+
+void SystemStub_Null::getPaletteEntry(int i, Color *c) {
+	*c = _palette[i];
+}
+
+void SystemStub_Null::setOverscanColor(int i) {
+}
+
+void SystemStub_Null::copyRect(int x, int y, int w, int h, const uint8_t *buf, int pitch) {
+}
+
+void SystemStub_Null::copyRectRgb24(int x, int y, int w, int h, const uint8_t *rgb) {
+}
+
+void SystemStub_Null::fadeScreen() {
+}
+
+void SystemStub_Null::updateScreen(int shakeOffset) {
+	++_framesCount;
+	if (_framesLimit != 0 && _framesCount >= _framesLimit) {
+		_pi.quit = true;
+	}
+}
+
+void SystemStub_Null::processEvents() {
+}
+
+void SystemStub_Null::sleep(int duration) {
+	if (duration > 0) {
+		advanceTime(duration * 1000);
+	}
+}
+
+uint32_t SystemStub_Null::getTimeStamp() {
+	return _timeStampUs / 1000;
+}
+
+uint64_t SystemStub_Null::getTimeStampUs() {
+	return _timeStampUs;
+}
+
+void SystemStub_Null::waitUntil(uint64_t timeStampUs) {
+	if (timeStampUs > _timeStampUs) {
+		advanceTime(timeStampUs - _timeStampUs);
+	}
+}
+
+void SystemStub_Null::advanceTime(uint64_t duration) {
+	_timeStampUs += duration;
+	if (_audioCbProc) {
+		// pull the samples the sound device would have consumed during that time, one full buffer at a time
+		_audioFrac += duration * _audioHz;
+		_audioPending += _audioFrac / 1000000;
+		_audioFrac %= 1000000;
+		while (_audioPending >= _audioBufSize) {
+			memset(_audioBuf, 0, _audioBufSize * sizeof(int16_t));
+			_audioCbProc(_audioCbData, _audioBuf, _audioBufSize);
+			if (_wavFile) {
+				writeWavSamples(_audioBuf, _audioBufSize);
+			}
+			_audioPending -= _audioBufSize;
+		}
+	}
+}
+
+void SystemStub_Null::startAudio(AudioCallback callback, void *param) {
+	_audioBuf = (int16_t *)malloc(_audioBufSize * sizeof(int16_t));
+	if (!_audioBuf) {
+		error("SystemStub_Null::startAudio() Unable to allocate audio buffer");
+	}
+	_audioCbProc = callback;
+	_audioCbData = param;
+	if (_wavPath) {
+		_wavFile = fopen(_wavPath, "wb");
+		if (!_wavFile) {
+			error("Unable to open '%s' for writing", _wavPath);
+		}
+		_wavSamplesCount = 0;
+		writeWavHeader();
+	}
+}
+
+void SystemStub_Null::stopAudio() {
+	_audioCbProc = 0;
+	free(_audioBuf);
+	_audioBuf = 0;
+	if (_wavFile) {
+		// the sizes are only known once rendering is complete
+		fseek(_wavFile, 0, SEEK_SET);
+		writeWavHeader();
+		fclose(_wavFile);
+		_wavFile = 0;
+		debug(DBG_INFO, "Rendered %d samples (%.1f seconds) to '%s'", _wavSamplesCount, _wavSamplesCount / (double)_audioHz, _wavPath);
+	}
+}
+
+static void writeLE16(uint8_t *p, uint16_t value) {
+	p[0] = value & 255;
+	p[1] = value >> 8;
+}
+
+static void writeLE32(uint8_t *p, uint32_t value) {
+	writeLE16(p, value & 0xFFFF);
+	writeLE16(p + 2, value >> 16);
+}
+
+// 16 bits mono PCM
+void SystemStub_Null::writeWavHeader() {
+	const uint32_t dataSize = _wavSamplesCount * sizeof(int16_t);
+	uint8_t hdr[44];
+	memcpy(hdr, "RIFF", 4);
+	writeLE32(hdr + 4, 36 + dataSize);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	writeLE32(hdr + 16, 16);
+	writeLE16(hdr + 20, 1);
+	writeLE16(hdr + 22, 1);
+	writeLE32(hdr + 24, _audioHz);
+	writeLE32(hdr + 28, _audioHz * sizeof(int16_t));
+	writeLE16(hdr + 32, sizeof(int16_t));
+	writeLE16(hdr + 34, 16);
+	memcpy(hdr + 36, "data", 4);
+	writeLE32(hdr + 40, dataSize);
+	fwrite(hdr, 1, sizeof(hdr), _wavFile);
+}
+
+void SystemStub_Null::writeWavSamples(const int16_t *samples, int count) {
+	uint8_t buf[1024];
+	while (count > 0) {
+		const int len = MIN(count, (int)sizeof(buf) / 2);
+		for (int i = 0; i < len; ++i) {
+			writeLE16(buf + i * 2, samples[i]);
+		}
+		if (fwrite(buf, 2, len, _wavFile) != (size_t)len) {
+			error("I/O error when writing '%s'", _wavPath);
+		}
+		_wavSamplesCount += len;
+		samples += len;
+		count -= len;
+	}
+}
+
+uint32_t SystemStub_Null::getOutputSampleRate() {
+	return _audioHz;
+}
+
+void SystemStub_Null::lockAudio() {
+}
+
+void SystemStub_Null::unlockAudio() {
+}
@@ -5,26 +5,89 @@
 
 #include <SDL.h>
 #include <SDL_gpu.h>
+#include "pixel_conv.h"
 #include "systemstub.h"
 #include "util.h"
 
-static const int kAudioHz = 22050;
+static const int kAudioMinBufSize = 64;
+static const int kAudioMaxBufSize = 8192;
 
 static const int kJoystickIndex = 0;
 static const int kJoystickCommitValue = 3200;
 
 static const uint32_t kPixelFormat = SDL_PIXELFORMAT_ABGR8888;
 
+// upload the whole texture when the dirty rectangle covers more than this percentage of the screen
+static const int kFullUploadPercent = 75;
+
+static const int kPresentFrameNew = 4;
+
+struct DirtyRect {
+	int x1, y1, x2, y2;
+
+	void clear() {
+		x1 = y1 = x2 = y2 = 0;
+	}
+	bool isEmpty() const {
+		return x1 >= x2;
+	}
+	void add(int x, int y, int w, int h) {
+		if (w <= 0 || h <= 0) {
+			return;
+		}
+		if (isEmpty()) {
+			x1 = x;
+			y1 = y;
+			x2 = x + w;
+			y2 = y + h;
+		} else {
+			x1 = MIN(x1, x);
+			y1 = MIN(y1, y);
+			x2 = MAX(x2, x + w);
+			y2 = MAX(y2, y + h);
+		}
+	}
+	void add(const DirtyRect &r) {
+		add(r.x1, r.y1, r.x2 - r.x1, r.y2 - r.y1);
+	}
+	bool isFullUpload(int screenW, int screenH) const {
+		return (x2 - x1) * (y2 - y1) * 100 > screenW * screenH * kFullUploadPercent;
+	}
+};
+
+// frame handed over to the presenter thread, only the dirty rectangle of the buffer is valid
+struct PresentFrame {
+	uint8_t *buffer;
+	uint32_t palette[256];
+	bool paletteDirty;
+	DirtyRect dirty;
+};
+
 struct SystemStub_SDL : SystemStub {
 	SDL_Window *_window;
     GPU_Target *_renderer;
+	SDL_GLContext _glContext;
     GPU_Image* _texture;
+    GPU_Image* _paletteTexture;
     uint32_t _shader;
     GPU_ShaderBlock _block;
 	SDL_GameController *_controller;
 	SDL_PixelFormat *_fmt;
 	const char *_caption;
 	uint32_t *_screenBuffer;
+	uint8_t *_indexBuffer;
+	bool _usePaletteTexture;
+	bool _paletteDirty;
+	DirtyRect _dirtyRect;
+	bool _usePresenterThread;
+	SDL_Thread *_presenterThread;
+	SDL_sem *_presenterSem;
+	SDL_atomic_t _presenterQuit;
+	// width in the high 16 bits, set by the event thread and read by the thread drawing the frames
+	SDL_atomic_t _windowSize;
+	PresentFrame _presentFrames[3];
+	SDL_atomic_t _presentLatest;
+	int _presentWrite, _presentRead;
 	bool _fullscreen;
 	uint8_t _overscanColor;
 	uint32_t _rgbPalette[256];
@@ -34,6 +97,15 @@ struct SystemStub_SDL : SystemStub {
 	bool _fadeOnUpdateScreen;
 	void (*_audioCbProc)(void *, int16_t *, int);
 	void *_audioCbData;
+	SDL_AudioDeviceID _audioDev;
+	int _audioHz;
+	int _audioBufSize;
+	uint64_t _audioCbCounter;
+	// set by the event thread when the device is paused, the audio callback restarts the late check
+	SDL_atomic_t _audioCbReset;
+	uint64_t _audioLateThreshold;
+	uint32_t _audioCbCount;
+	uint32_t _audioUnderrunsCount;
 
 	virtual ~SystemStub_SDL() {}
 	virtual void init(const char *title, int w, int h, bool fullscreen);
@@ -51,6 +123,8 @@ struct SystemStub_SDL : SystemStub {
 	virtual void processEvents();
 	virtual void sleep(int duration);
 	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampUs();
+	virtual void waitUntil(uint64_t timeStampUs);
 	virtual void startAudio(AudioCallback callback, void *param);
 	virtual void stopAudio();
 	virtual uint32_t getOutputSampleRate();
@@ -58,11 +132,22 @@ struct SystemStub_SDL : SystemStub {
 	virtual void unlockAudio();
 
 	void setPaletteColor(int color, int r, int g, int b);
+	uint8_t findPaletteColor(int r, int g, int b);
 	void processEvent(const SDL_Event &ev, bool &paused);
 	void prepareGraphics();
 	void cleanupGraphics();
 	void changeGraphics(bool fullscreen);
+	void initGPU();
+	void quitGPU();
+	void startPresenter();
+	void stopPresenter();
+	void presenterLoop();
+	void publishFrame();
+	void drawFrame(const uint8_t *buf, const uint32_t *palette, bool paletteDirty, const DirtyRect &dirty);
+	void uploadTexture(const uint8_t *buf, const DirtyRect &dirty);
 	void drawRect(int x, int y, int w, int h, uint8_t color);
+	int getBytesPerPixel() const { return _usePaletteTexture ? 1 : sizeof(uint32_t); }
+	const uint8_t *getScreenBuffer() const { return _usePaletteTexture ? _indexBuffer : (const uint8_t *)_screenBuffer; }
 };
 
 SystemStub *SystemStub_SDL_create() {
@@ -78,14 +163,31 @@ void SystemStub_SDL::init(const char *title, int w, int h, bool fullscreen) {
 	memset(&_pi, 0, sizeof(_pi));
 	_window = 0;
 	_renderer = 0;
+	_glContext = 0;
 	_texture = 0;
+	_paletteTexture = 0;
+	_shader = 0;
 	_fmt = SDL_AllocFormat(kPixelFormat);
 	_screenBuffer = 0;
+	_indexBuffer = 0;
+	_usePaletteTexture = g_options.use_palette_texture;
+	_paletteDirty = true;
+	_usePresenterThread = g_options.use_presenter_thread;
+	_presenterThread = 0;
+	_presenterSem = 0;
+	SDL_AtomicSet(&_windowSize, 0);
+	memset(_presentFrames, 0, sizeof(_presentFrames));
 	_fadeOnUpdateScreen = false;
+	_audioCbProc = 0;
+	_audioCbData = 0;
+	_audioDev = 0;
+	_audioHz = g_options.audio_sample_rate;
+	_audioBufSize = g_options.audio_buffer_size;
 	_fullscreen = fullscreen;
 	memset(_rgbPalette, 0, sizeof(_rgbPalette));
 	memset(_darkPalette, 0, sizeof(_darkPalette));
 	_screenW = _screenH = 0;
+	_dirtyRect.clear();
 	setScreenSize(w, h);
 	_joystick = 0;
 	_controller = 0;
@@ -106,6 +208,14 @@ void SystemStub_SDL::destroy() {
 		free(_screenBuffer);
 		_screenBuffer = 0;
 	}
+	if (_indexBuffer) {
+		free(_indexBuffer);
+		_indexBuffer = 0;
+	}
+	for (int i = 0; i < 3; ++i) {
+		free(_presentFrames[i].buffer);
+		_presentFrames[i].buffer = 0;
+	}
 	if (_fmt) {
 		SDL_FreeFormat(_fmt);
 		_fmt = 0;
@@ -130,19 +240,55 @@ void SystemStub_SDL::setScreenSize(int w, int h) {
 		free(_screenBuffer);
 		_screenBuffer = 0;
 	}
-	const int screenBufferSize = w * h * sizeof(uint32_t);
-	_screenBuffer = (uint32_t *)calloc(1, screenBufferSize);
-	if (!_screenBuffer) {
-		error("SystemStub_SDL::setScreenSize() Unable to allocate offscreen buffer, w=%d, h=%d", w, h);
+	if (_indexBuffer) {
+		free(_indexBuffer);
+		_indexBuffer = 0;
+	}
+	if (_usePaletteTexture) {
+		_indexBuffer = (uint8_t *)calloc(1, w * h);
+		if (!_indexBuffer) {
+			error("SystemStub_SDL::setScreenSize() Unable to allocate offscreen buffer, w=%d, h=%d", w, h);
+		}
+	} else {
+		const int screenBufferSize = w * h * sizeof(uint32_t);
+		_screenBuffer = (uint32_t *)calloc(1, screenBufferSize);
+		if (!_screenBuffer) {
+			error("SystemStub_SDL::setScreenSize() Unable to allocate offscreen buffer, w=%d, h=%d", w, h);
+		}
 	}
 	_screenW = w;
 	_screenH = h;
+	if (_usePresenterThread) {
+		for (int i = 0; i < 3; ++i) {
+			free(_presentFrames[i].buffer);
+			_presentFrames[i].buffer = (uint8_t *)calloc(1, w * h * getBytesPerPixel());
+			if (!_presentFrames[i].buffer) {
+				error("SystemStub_SDL::setScreenSize() Unable to allocate present buffer, w=%d, h=%d", w, h);
+			}
+		}
+	}
 	prepareGraphics();
 }
 
 void SystemStub_SDL::setPaletteColor(int color, int r, int g, int b) {
 	_rgbPalette[color] = SDL_MapRGB(_fmt, r, g, b);
 	_darkPalette[color] = SDL_MapRGB(_fmt, r / 4, g / 4, b / 4);
+	_paletteDirty = true;
+}
+
+uint8_t SystemStub_SDL::findPaletteColor(int r, int g, int b) {
+	int bestColor = 0;
+	int bestDist = 0x7FFFFFFF;
+	for (int i = 0; i < 256; ++i) {
+		uint8_t pr, pg, pb;
+		SDL_GetRGB(_rgbPalette[i], _fmt, &pr, &pg, &pb);
+		const int dist = (pr - r) * (pr - r) + (pg - g) * (pg - g) + (pb - b) * (pb - b);
+		if (dist < bestDist) {
+			bestDist = dist;
+			bestColor = i;
+		}
+	}
+	return bestColor;
 }
 
 void SystemStub_SDL::setPalette(const uint8_t *pal, int n) {
@@ -190,16 +336,19 @@ void SystemStub_SDL::copyRect(int x, int y, int w, int h, const uint8_t *buf, in
 	if (y + h > _screenH) {
 		h = _screenH - y;
 	}
+	_dirtyRect.add(x, y, w, h);
 
-	uint32_t *p = _screenBuffer + y * _screenW + x;
 	buf += y * pitch + x;
 
-	for (int j = 0; j < h; ++j) {
-		for (int i = 0; i < w; ++i) {
-			p[i] = _rgbPalette[buf[i]];
+	if (_usePaletteTexture) {
+		uint8_t *p = _indexBuffer + y * _screenW + x;
+		for (int j = 0; j < h; ++j) {
+			memcpy(p, buf, w);
+			p += _screenW;
+			buf += pitch;
 		}
-		p += _screenW;
-		buf += pitch;
+	} else {
+		convertPal8(_screenBuffer + y * _screenW + x, _screenW, buf, pitch, w, h, _rgbPalette);
 	}
 
 	if (_pi.dbgMask & PlayerInput::DF_DBLOCKS) {
@@ -209,13 +358,37 @@ void SystemStub_SDL::copyRect(int x, int y, int w, int h, const uint8_t *buf, in
 
 void SystemStub_SDL::copyRectRgb24(int x, int y, int w, int h, const uint8_t *rgb) {
 	assert(x >= 0 && x + w <= _screenW && y >= 0 && y + h <= _screenH);
-	uint32_t *p = _screenBuffer + y * _screenW + x;
-
-	for (int j = 0; j < h; ++j) {
-		for (int i = 0; i < w; ++i) {
-			p[i] = SDL_MapRGB(_fmt, rgb[0], rgb[1], rgb[2]); rgb += 3;
+	_dirtyRect.add(x, y, w, h);
+
+	if (_usePaletteTexture) {
+		// no direct color with the indexed texture, use the closest palette entry
+		// the images have few distinct colors, the palette search results are cached for the call
+		static const uint32_t kNoColor = 0xFFFFFFFF;
+		uint32_t cacheRgb[256];
+		uint8_t cacheColor[256];
+		memset(cacheRgb, 0xFF, sizeof(cacheRgb));
+		uint32_t lastRgb = kNoColor;
+		uint8_t lastColor = 0;
+		uint8_t *p = _indexBuffer + y * _screenW + x;
+		for (int j = 0; j < h; ++j) {
+			for (int i = 0; i < w; ++i) {
+				const uint32_t color = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+				if (color != lastRgb) {
+					const int hash = (color * 2654435761U) >> 24;
+					if (cacheRgb[hash] != color) {
+						cacheRgb[hash] = color;
+						cacheColor[hash] = findPaletteColor(rgb[0], rgb[1], rgb[2]);
+					}
+					lastRgb = color;
+					lastColor = cacheColor[hash];
+				}
+				p[i] = lastColor;
+				rgb += 3;
+			}
+			p += _screenW;
 		}
-		p += _screenW;
+	} else {
+		convertRgb24(_screenBuffer + y * _screenW + x, _screenW, rgb, w * 3, w, h, _fmt->Rshift, _fmt->Gshift, _fmt->Bshift, _fmt->Amask);
 	}
 
 	if (_pi.dbgMask & PlayerInput::DF_DBLOCKS) {
@@ -228,15 +401,34 @@ void SystemStub_SDL::fadeScreen() {
 }
 
 void SystemStub_SDL::updateScreen(int shakeOffset) {
+	if (_usePresenterThread) {
+		publishFrame();
+	} else {
+		drawFrame(getScreenBuffer(), _rgbPalette, _paletteDirty, _dirtyRect);
+	}
+	_paletteDirty = false;
+	_dirtyRect.clear();
+}
+
+void SystemStub_SDL::drawFrame(const uint8_t *buf, const uint32_t *palette, bool paletteDirty, const DirtyRect &dirty) {
     GPU_Clear(_renderer);
 
-    GPU_UpdateImageBytes(_texture, NULL, (const uint8_t*)_screenBuffer, _screenW * sizeof(uint32_t));
+    uploadTexture(buf, dirty);
+    if (_usePaletteTexture && paletteDirty) {
+        GPU_UpdateImageBytes(_paletteTexture, NULL, (const uint8_t*)palette, 256 * sizeof(uint32_t));
+    }
 
     // *** SHADER DRAW ***
     GPU_ActivateShaderProgram(_shader, &_block);
 
-    int32_t w, h;
-    SDL_GetWindowSize(_window, &w, &h);
+    GPU_SetUniformi(GPU_GetUniformLocation(_shader, "use_palette"), _usePaletteTexture ? 1 : 0);
+    if (_usePaletteTexture) {
+        GPU_SetShaderImage(_paletteTexture, GPU_GetUniformLocation(_shader, "palette"), 1);
+    }
+
+    const int size = SDL_AtomicGet(&_windowSize);
+    const int w = size >> 16;
+    const int h = size & 0xFFFF;
 
     const float aspect = _screenW/float(_screenH);
     const float scaleW = w/float(_screenW);
@@ -324,7 +516,14 @@ void SystemStub_SDL::processEvent(const SDL_Event &ev, bool &paused) {
 		case SDL_WINDOWEVENT_FOCUS_GAINED:
 		case SDL_WINDOWEVENT_FOCUS_LOST:
 			paused = (ev.window.event == SDL_WINDOWEVENT_FOCUS_LOST);
-			SDL_PauseAudio(paused);
+			if (_audioDev) {
+				SDL_PauseAudioDevice(_audioDev, paused);
+				// the device does not call back while paused, this is not an underrun
+				SDL_AtomicSet(&_audioCbReset, 1);
+			}
+			break;
+		case SDL_WINDOWEVENT_SIZE_CHANGED:
+			SDL_AtomicSet(&_windowSize, (ev.window.data1 << 16) | ev.window.data2);
 			break;
 		}
 		break;
@@ -502,6 +701,9 @@ void SystemStub_SDL::processEvent(const SDL_Event &ev, bool &paused) {
 			case SDLK_r:
 				_pi.rewind = true;
 				break;
+			case SDLK_p:
+				_pi.dumpStats = true;
+				break;
 			case SDLK_KP_PLUS:
 			case SDLK_PAGEUP:
 				_pi.stateSlot = 1;
@@ -604,44 +806,92 @@ uint32_t SystemStub_SDL::getTimeStamp() {
 	return SDL_GetTicks();
 }
 
+uint64_t SystemStub_SDL::getTimeStampUs() {
+	static const uint64_t freq = SDL_GetPerformanceFrequency();
+	const uint64_t counter = SDL_GetPerformanceCounter();
+	return (counter / freq) * 1000000 + (counter % freq) * 1000000 / freq;
+}
+
+void SystemStub_SDL::waitUntil(uint64_t timeStampUs) {
+	// SDL_Delay can oversleep by a scheduler quantum, sleep until close to the deadline and spin for the rest
+	static const uint64_t kSpinUs = 1500;
+	while (1) {
+		const uint64_t now = getTimeStampUs();
+		if (now >= timeStampUs) {
+			break;
+		}
+		const uint64_t remaining = timeStampUs - now;
+		if (remaining > kSpinUs) {
+			SDL_Delay((remaining - kSpinUs) / 1000);
+		}
+	}
+}
+
 static void mixAudioS16(void *param, uint8_t *buf, int len) {
 	SystemStub_SDL *stub = (SystemStub_SDL *)param;
+	// the device asks for the next buffer when the previous one is about to be played out,
+	// a callback much later than one buffer period means the device ran dry
+	const uint64_t counter = SDL_GetPerformanceCounter();
+	if (SDL_AtomicSet(&stub->_audioCbReset, 0)) {
+		stub->_audioCbCounter = 0;
+	}
+	if (stub->_audioCbCounter != 0 && counter - stub->_audioCbCounter > stub->_audioLateThreshold) {
+		++stub->_audioUnderrunsCount;
+	}
+	stub->_audioCbCounter = counter;
+	++stub->_audioCbCount;
 	memset(buf, 0, len);
 	stub->_audioCbProc(stub->_audioCbData, (int16_t *)buf, len / 2);
 }
 
 void SystemStub_SDL::startAudio(AudioCallback callback, void *param) {
-	SDL_AudioSpec desired;
+	SDL_AudioSpec desired, obtained;
 	memset(&desired, 0, sizeof(desired));
-	desired.freq = kAudioHz;
+	desired.freq = _audioHz;
 	desired.format = AUDIO_S16SYS;
 	desired.channels = 1;
-	desired.samples = 2048;
+	desired.samples = CLIP(_audioBufSize, kAudioMinBufSize, kAudioMaxBufSize);
 	desired.callback = mixAudioS16;
 	desired.userdata = this;
-	if (SDL_OpenAudio(&desired, 0) == 0) {
-		_audioCbProc = callback;
-		_audioCbData = param;
-		SDL_PauseAudio(0);
-	} else {
-		error("SystemStub_SDL::startAudio() Unable to open sound device");
+	_audioCbProc = callback;
+	_audioCbData = param;
+	_audioDev = SDL_OpenAudioDevice(0, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (_audioDev == 0) {
+		error("SystemStub_SDL::startAudio() Unable to open sound device, %s", SDL_GetError());
 	}
+	_audioHz = obtained.freq;
+	_audioBufSize = obtained.samples;
+	_audioCbCounter = 0;
+	SDL_AtomicSet(&_audioCbReset, 0);
+	_audioLateThreshold = SDL_GetPerformanceFrequency() * _audioBufSize * 3 / (_audioHz * 2);
+	_audioCbCount = 0;
+	_audioUnderrunsCount = 0;
+	debug(DBG_INFO, "Audio output %d Hz, %d samples buffer (%d ms)", _audioHz, _audioBufSize, _audioBufSize * 1000 / _audioHz);
+	SDL_PauseAudioDevice(_audioDev, 0);
 }
 
 void SystemStub_SDL::stopAudio() {
-	SDL_CloseAudio();
+	if (_audioDev) {
+		SDL_CloseAudioDevice(_audioDev);
+		_audioDev = 0;
+		debug(DBG_INFO, "Audio: %d callbacks, %d underruns", _audioCbCount, _audioUnderrunsCount);
+	}
 }
 
 uint32_t SystemStub_SDL::getOutputSampleRate() {
-	return kAudioHz;
+	return _audioHz;
 }
 
 void SystemStub_SDL::lockAudio() {
-	SDL_LockAudio();
+	if (_audioDev) {
+		SDL_LockAudioDevice(_audioDev);
+	}
 }
 
 void SystemStub_SDL::unlockAudio() {
-	SDL_UnlockAudio();
+	if (_audioDev) {
+		SDL_UnlockAudioDevice(_audioDev);
+	}
 }
 
 void SystemStub_SDL::prepareGraphics() {
@@ -658,14 +908,43 @@ void SystemStub_SDL::prepareGraphics() {
     int scale = 4; // Initial scale of non-fullscreen window
 
 	_window = SDL_CreateWindow(_caption, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, _screenW*scale, _screenH*scale, flags);
+	int w, h;
+	SDL_GetWindowSize(_window, &w, &h);
+	SDL_AtomicSet(&_windowSize, (w << 16) | h);
+
+    // the new texture needs a full upload
+    _dirtyRect.add(0, 0, _screenW, _screenH);
+    _paletteDirty = true;
+
+	// the context is always created on the main thread, Cocoa does not support creating it on another one
+	initGPU();
+	if (_usePresenterThread) {
+		// a context is current on one thread at a time, the presenter takes it over
+		SDL_GL_MakeCurrent(_window, 0);
+		startPresenter();
+	}
+}
 
+void SystemStub_SDL::initGPU() {
     GPU_SetInitWindow(SDL_GetWindowID(_window));
 
-    GPU_SetPreInitFlags(GPU_INIT_DISABLE_VSYNC | GPU_INIT_REQUEST_COMPATIBILITY_PROFILE);
+    int flags = GPU_INIT_REQUEST_COMPATIBILITY_PROFILE;
+    if (!g_options.enable_vsync) {
+        flags |= GPU_INIT_DISABLE_VSYNC;
+    }
+    GPU_SetPreInitFlags(flags);
 
     _renderer = GPU_Init(_screenW, _screenH, GPU_DEFAULT_INIT_FLAGS);
+	_glContext = SDL_GL_GetCurrentContext();
 
-    _texture = GPU_CreateImage(_screenW, _screenH, GPU_FORMAT_RGBA);
+    if (_usePaletteTexture) {
+        _texture = GPU_CreateImage(_screenW, _screenH, GPU_FORMAT_LUMINANCE);
+
+        _paletteTexture = GPU_CreateImage(256, 1, GPU_FORMAT_RGBA);
+        GPU_SetImageFilter(_paletteTexture, GPU_FILTER_NEAREST);
+    } else {
+        _texture = GPU_CreateImage(_screenW, _screenH, GPU_FORMAT_RGBA);
+    }
 
     GPU_SetAnchor(_texture, 0, 0);
     GPU_SetImageFilter(_texture, GPU_FILTER_NEAREST);
@@ -685,10 +964,6 @@ void SystemStub_SDL::prepareGraphics() {
         error("Failed to load pixel shader: %s", GPU_GetShaderMessage());
     }
 
-    if (_shader) {
-        GPU_FreeShaderProgram(_shader);
-    }
-
     _shader = GPU_LinkShaders(vertex, pixel);
     if (_shader) {
         _block = GPU_LoadShaderBlock(_shader, "gpu_Vertex", "gpu_TexCoord", "gpu_Color", "gpu_ModelViewProjectionMatrix");
@@ -698,15 +973,33 @@ void SystemStub_SDL::prepareGraphics() {
     // ********************
 }
 
-void SystemStub_SDL::cleanupGraphics() {
+void SystemStub_SDL::quitGPU() {
 	if (_texture) {
         GPU_FreeImage(_texture);
 		_texture = 0;
 	}
+	if (_paletteTexture) {
+        GPU_FreeImage(_paletteTexture);
+		_paletteTexture = 0;
+	}
+	if (_shader) {
+        GPU_FreeShaderProgram(_shader);
+		_shader = 0;
+	}
 	if (_renderer) {
         GPU_Quit();
 		_renderer = 0;
+		_glContext = 0;
 	}
+}
+
+void SystemStub_SDL::cleanupGraphics() {
+	if (_usePresenterThread) {
+		stopPresenter();
+		// the presenter released the context, it is destroyed on the main thread
+		SDL_GL_MakeCurrent(_window, _glContext);
+	}
+	quitGPU();
 	if (_window) {
 		SDL_DestroyWindow(_window);
 		_window = 0;
@@ -730,6 +1023,15 @@ void SystemStub_SDL::drawRect(int x, int y, int w, int h, uint8_t color) {
 	const int x2 = x + w - 1;
 	const int y2 = y + h - 1;
 	assert(x1 >= 0 && x2 < _screenW && y1 >= 0 && y2 < _screenH);
+	if (_usePaletteTexture) {
+		for (int i = x1; i <= x2; ++i) {
+			*(_indexBuffer + y1 * _screenW + i) = *(_indexBuffer + y2 * _screenW + i) = color;
+		}
+		for (int j = y1; j <= y2; ++j) {
+			*(_indexBuffer + j * _screenW + x1) = *(_indexBuffer + j * _screenW + x2) = color;
+		}
+		return;
+	}
 	for (int i = x1; i <= x2; ++i) {
 		*(_screenBuffer + y1 * _screenW + i) = *(_screenBuffer + y2 * _screenW + i) = _rgbPalette[color];
 	}
@@ -737,3 +1039,104 @@ void SystemStub_SDL::drawRect(int x, int y, int w, int h, uint8_t color) {
 		*(_screenBuffer + j * _screenW + x1) = *(_screenBuffer + j * _screenW + x2) = _rgbPalette[color];
 	}
 }
+
+void SystemStub_SDL::uploadTexture(const uint8_t *buf, const DirtyRect &dirty) {
+	if (dirty.isEmpty()) {
+		// texture is up to date
+		return;
+	}
+	const int bpp = getBytesPerPixel();
+	if (dirty.isFullUpload(_screenW, _screenH)) {
+		GPU_UpdateImageBytes(_texture, NULL, buf, _screenW * bpp);
+	} else {
+		GPU_Rect r;
+		r.x = dirty.x1;
+		r.y = dirty.y1;
+		r.w = dirty.x2 - dirty.x1;
+		r.h = dirty.y2 - dirty.y1;
+		GPU_UpdateImageBytes(_texture, &r, buf + (dirty.y1 * _screenW + dirty.x1) * bpp, _screenW * bpp);
+	}
+}
+
+static int presenterThread(void *param) {
+	SystemStub_SDL *stub = (SystemStub_SDL *)param;
+	stub->presenterLoop();
+	return 0;
+}
+
+void SystemStub_SDL::startPresenter() {
+	// triple buffer : one slot written by the game thread, one drawn by the presenter and the latest completed frame
+	_presentWrite = 0;
+	SDL_AtomicSet(&_presentLatest, 1);
+	_presentRead = 2;
+	for (int i = 0; i < 3; ++i) {
+		_presentFrames[i].paletteDirty = false;
+		_presentFrames[i].dirty.clear();
+	}
+	SDL_AtomicSet(&_presenterQuit, 0);
+	_presenterSem = SDL_CreateSemaphore(0);
+	_presenterThread = SDL_CreateThread(presenterThread, "presenter", this);
+	if (!_presenterThread) {
+		error("SystemStub_SDL::startPresenter() Unable to create thread");
+	}
+}
+
+void SystemStub_SDL::stopPresenter() {
+	if (_presenterThread) {
+		SDL_AtomicSet(&_presenterQuit, 1);
+		SDL_SemPost(_presenterSem);
+		SDL_WaitThread(_presenterThread, 0);
+		_presenterThread = 0;
+	}
+	if (_presenterSem) {
+		SDL_DestroySemaphore(_presenterSem);
+		_presenterSem = 0;
+	}
+}
+
+void SystemStub_SDL::presenterLoop() {
+	SDL_GL_MakeCurrent(_window, _glContext);
+	while (!SDL_AtomicGet(&_presenterQuit)) {
+		SDL_SemWaitTimeout(_presenterSem, 100);
+		if ((SDL_AtomicGet(&_presentLatest) & kPresentFrameNew) == 0) {
+			continue;
+		}
+		_presentRead = SDL_AtomicSet(&_presentLatest, _presentRead) & 3;
+		const PresentFrame *f = &_presentFrames[_presentRead];
+		drawFrame(f->buffer, f->palette, f->paletteDirty, f->dirty);
+	}
+	SDL_GL_MakeCurrent(_window, 0);
+}
+
+void SystemStub_SDL::publishFrame() {
+	PresentFrame *f = &_presentFrames[_presentWrite];
+	f->dirty = _dirtyRect;
+	f->paletteDirty = _paletteDirty;
+	const int latest = SDL_AtomicGet(&_presentLatest);
+	if (latest & kPresentFrameNew) {
+		// the previous frame may be dropped, carry its changes over (uploading more than needed is harmless)
+		const PresentFrame *prev = &_presentFrames[latest & 3];
+		f->dirty.add(prev->dirty);
+		f->paletteDirty |= prev->paletteDirty;
+	}
+	if (f->dirty.isFullUpload(_screenW, _screenH)) {
+		// the presenter uploads the whole buffer, the pixels outside the rectangle must be current too
+		f->dirty.clear();
+		f->dirty.add(0, 0, _screenW, _screenH);
+	}
+	if (!f->dirty.isEmpty()) {
+		const int bpp = getBytesPerPixel();
+		const int offset = (f->dirty.y1 * _screenW + f->dirty.x1) * bpp;
+		const int size = (f->dirty.x2 - f->dirty.x1) * bpp;
+		const uint8_t *src = getScreenBuffer() + offset;
+		uint8_t *dst = f->buffer + offset;
+		for (int y = f->dirty.y1; y < f->dirty.y2; ++y) {
+			memcpy(dst, src, size);
+			src += _screenW * bpp;
+			dst += _screenW * bpp;
+		}
+	}
+	memcpy(f->palette, _rgbPalette, sizeof(_rgbPalette));
+	_presentWrite = SDL_AtomicSet(&_presentLatest, _presentWrite | kPresentFrameNew) & 3;
+	SDL_SemPost(_presenterSem);
+}
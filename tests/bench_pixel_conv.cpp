@@ -0,0 +1,82 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <time.h>
+#include "pixel_conv.h"
+#include "util.h"
+
+// compares convertPal8() with a scalar loop on a game screen, the outputs must be identical
+
+static const int kScreenW = 256;
+static const int kScreenH = 224;
+
+static uint8_t _screen[kScreenW * kScreenH];
+static uint32_t _palette[256];
+static uint32_t _refFrame[kScreenW * kScreenH];
+static uint32_t _frame[kScreenW * kScreenH];
+
+static void convertPal8_ref(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *pal) {
+	for (int j = 0; j < h; ++j) {
+		for (int i = 0; i < w; ++i) {
+			dst[i] = pal[src[i]];
+		}
+		dst += dstPitch;
+		src += srcPitch;
+	}
+}
+
+struct Rect {
+	const char *name;
+	int x, y, w, h;
+};
+
+static const Rect _rects[] = {
+	{ "full screen", 0, 0, kScreenW, kScreenH },
+	{ "dirty rectangle", 37, 51, 133, 90 },
+	{ "inventory row", 0, 176, kScreenW, 1 }
+};
+
+static double measure(void (*convert)(uint32_t *, int, const uint8_t *, int, int, int, const uint32_t *), uint32_t *frame, const Rect *r, int *framesCount) {
+	const int offset = r->y * kScreenW + r->x;
+	const clock_t start = clock();
+	clock_t end;
+	*framesCount = 0;
+	do {
+		for (int i = 0; i < 100; ++i) {
+			convert(frame + offset, kScreenW, _screen + offset, kScreenW, r->w, r->h, _palette);
+		}
+		*framesCount += 100;
+		end = clock();
+	} while (end - start < CLOCKS_PER_SEC / 2);
+	return (end - start) / (double)CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t seed = 0x12345678;
+	for (int i = 0; i < kScreenW * kScreenH; ++i) {
+		seed = seed * 1103515245 + 12345;
+		_screen[i] = seed >> 24;
+	}
+	for (int i = 0; i < 256; ++i) {
+		_palette[i] = 0xFF000000 | (i * 0x010307);
+	}
+	int errors = 0;
+	for (int i = 0; i < ARRAYSIZE(_rects); ++i) {
+		const Rect *r = &_rects[i];
+		memset(_refFrame, 0, sizeof(_refFrame));
+		memset(_frame, 0, sizeof(_frame));
+		int refFrames, frames;
+		const double refSeconds = measure(convertPal8_ref, _refFrame, r, &refFrames);
+		const double seconds = measure(convertPal8, _frame, r, &frames);
+		if (memcmp(_refFrame, _frame, sizeof(_frame)) != 0) {
+			fprintf(stderr, "%s: output differs from the scalar loop\n", r->name);
+			++errors;
+		}
+		const double refNs = refSeconds * 1e9 / refFrames;
+		const double ns = seconds * 1e9 / frames;
+		printf("%-16s %3dx%-3d scalar %8.0f ns, convertPal8 %8.0f ns (x%.2f)\n", r->name, r->w, r->h, refNs, ns, refNs / ns);
+	}
+	return errors != 0 ? 1 : 0;
+}
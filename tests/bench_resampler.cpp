@@ -0,0 +1,78 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <math.h>
+#include <time.h>
+#include "resampler.h"
+#include "util.h"
+
+// times the resampling modes and measures their residual, to check the audio_resampler default on the target hardware
+
+// a 1 kHz sine in a 8-bit sample at the rate of the sound effects, played at the usual output rate
+static const int kSrcRate = 6000;
+static const int kDstRate = 48000;
+static const int kToneFreq = 1000;
+static const int kSrcLen = 1 << 16;
+static const int kBlockSize = 2048;
+// away from the start of the sample, the first taps are clamped
+static const int kStartPos = 4096;
+
+static uint8_t _src[kSrcLen];
+static int16_t _dst[kDstRate];
+
+static double measureTime(uint32_t inc) {
+	const uint32_t endPos = (uint32_t)(kSrcLen - kBlockSize) << kResampleFracBits;
+	uint32_t pos = kStartPos << kResampleFracBits;
+	int samplesCount = 0;
+	const clock_t start = clock();
+	clock_t end;
+	do {
+		for (int i = 0; i < 100; ++i) {
+			pos = resampleS8(_dst, _src, kSrcLen, pos, inc, kBlockSize);
+			if (pos >= endPos) {
+				pos = kStartPos << kResampleFracBits;
+			}
+		}
+		samplesCount += 100 * kBlockSize;
+		end = clock();
+	} while (end - start < CLOCKS_PER_SEC / 2);
+	return (end - start) * 1e9 / CLOCKS_PER_SEC / samplesCount;
+}
+
+// everything but the fundamental: interpolation images and 8-bit quantization
+static double measureResidual(uint32_t inc) {
+	resampleS8(_dst, _src, kSrcLen, kStartPos << kResampleFracBits, inc, kDstRate);
+	const double w = 2 * M_PI * kToneFreq / kDstRate;
+	double c = 0., s = 0.;
+	for (int i = 0; i < kDstRate; ++i) {
+		c += _dst[i] * cos(w * i);
+		s += _dst[i] * sin(w * i);
+	}
+	c *= 2. / kDstRate;
+	s *= 2. / kDstRate;
+	double signal = 0., noise = 0.;
+	for (int i = 0; i < kDstRate; ++i) {
+		const double tone = c * cos(w * i) + s * sin(w * i);
+		const double residual = _dst[i] - tone;
+		signal += tone * tone;
+		noise += residual * residual;
+	}
+	return 10. * log10(noise / signal);
+}
+
+int main(int argc, char *argv[]) {
+	for (int i = 0; i < kSrcLen; ++i) {
+		_src[i] = (uint8_t)(int8_t)floor(100. * sin(2 * M_PI * kToneFreq * i / kSrcRate) + .5);
+	}
+	const uint32_t inc = (kSrcRate << kResampleFracBits) / kDstRate;
+	static const char *names[] = { "nearest", "linear", "polyphase" };
+	for (int quality = kResampleNearest; quality <= kResamplePolyphase; ++quality) {
+		setResampleQuality(quality);
+		const double ns = measureTime(inc);
+		const double db = measureResidual(inc);
+		printf("%d %-9s %5.1f ns/sample, residual %6.1f dB\n", quality, names[quality], ns, db);
+	}
+	return 0;
+}
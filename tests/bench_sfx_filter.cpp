@@ -0,0 +1,114 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <math.h>
+#include <time.h>
+#include "fs.h"
+#include "mixer.h"
+#include "systemstub.h"
+#include "util.h"
+
+// compares ButterworthFilter with the original float filter on the output of the _module68 sound effects music
+
+Options g_options;
+const char *g_caption = "bench_sfx_filter";
+
+// the float coefficients are designed for this rate
+static const int kSampleRate = 22050;
+static const int kDuration = 10;
+// the fixed point history rounds differently, a few units in the last place are expected
+static const int kMaxDiff = 4;
+
+struct ButterworthFilter_ref {
+	float xf[3], yf[3];
+
+	void reset() {
+		memset(xf, 0, sizeof(xf));
+		memset(yf, 0, sizeof(yf));
+	}
+	void process(int16_t *p, int len) {
+		static const float GAIN = 7.655158005e+00;
+		for (int i = 0; i < len; ++i) {
+			xf[0] = xf[1]; xf[1] = xf[2];
+			xf[2] = p[i] / GAIN;
+			yf[0] = yf[1]; yf[1] = yf[2];
+			yf[2] = (xf[0] + xf[2]) + 2 * xf[1] + (-0.2729352339 * yf[0]) + (0.7504117278 * yf[1]);
+			p[i] = (int16_t)CLIP(yf[2], -32768.f, 32767.f);
+		}
+	}
+};
+
+// the mixer filters each tick of samples
+template<typename F>
+static double measure(F *filter, int16_t *dst, const int16_t *src, int count, int tickSize) {
+	static const int kRuns = 50;
+	double seconds = 0.;
+	for (int i = 0; i < kRuns; ++i) {
+		memcpy(dst, src, count * sizeof(int16_t));
+		filter->reset();
+		const clock_t start = clock();
+		for (int pos = 0; pos < count; pos += tickSize) {
+			filter->process(dst + pos, MIN(tickSize, count - pos));
+		}
+		seconds += (clock() - start) / (double)CLOCKS_PER_SEC;
+	}
+	return seconds / kRuns;
+}
+
+int main(int argc, char *argv[]) {
+	g_options.audio_sample_rate = kSampleRate;
+	g_options.audio_buffer_size = 512;
+	SystemStub *stub = SystemStub_Null_create(0, 0);
+	stub->init("bench_sfx_filter", 256, 224, false);
+	FileSystem fs(".");
+	Mixer mix(&fs, stub);
+	mix.init();
+	const int count = kSampleRate * kDuration;
+	const int tickSize = kSampleRate / 50;
+	int16_t *src = (int16_t *)calloc(count, sizeof(int16_t));
+	int16_t *refOutput = (int16_t *)malloc(count * sizeof(int16_t));
+	int16_t *output = (int16_t *)malloc(count * sizeof(int16_t));
+	if (!src || !refOutput || !output) {
+		error("Unable to allocate sample buffers");
+	}
+	// unfiltered music, the player is driven directly instead of through the premix hook
+	SfxPlayer *sfx = &mix._sfx;
+	sfx->play(68);
+	for (int pos = 0; pos < count; pos += tickSize) {
+		sfx->handleTick();
+		sfx->mixSamples(src + pos, MIN(tickSize, count - pos));
+	}
+	sfx->stop();
+
+	ButterworthFilter_ref refFilter;
+	const double refSeconds = measure(&refFilter, refOutput, src, count, tickSize);
+	ButterworthFilter filter;
+	filter.init(3300, kSampleRate);
+	const double seconds = measure(&filter, output, src, count, tickSize);
+
+	int maxDiff = 0;
+	double noise = 0.;
+	double signal = 0.;
+	for (int i = 0; i < count; ++i) {
+		const int diff = ABS(refOutput[i] - output[i]);
+		maxDiff = MAX(maxDiff, diff);
+		noise += (double)diff * diff;
+		signal += (double)refOutput[i] * refOutput[i];
+	}
+	printf("%d s at %d Hz: float %.0f us, fixed point %.0f us (x%.2f)\n", kDuration, kSampleRate, refSeconds * 1e6, seconds * 1e6, refSeconds / seconds);
+	printf("max difference %d, error %.1f dB\n", maxDiff, 10. * log10(noise / MAX(signal, 1.)));
+
+	free(src);
+	free(refOutput);
+	free(output);
+	mix.free();
+	stub->destroy();
+	delete stub;
+	if (maxDiff > kMaxDiff) {
+		fprintf(stderr, "Difference with the float filter above %d\n", kMaxDiff);
+		return 1;
+	}
+	return 0;
+}
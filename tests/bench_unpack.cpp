@@ -0,0 +1,164 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <time.h>
+#include "unpack.h"
+#include "unpack_ref.h"
+#include "util.h"
+
+// compares the throughput of bytekiller_unpack() with the reference decoder on the packed data of a DATA directory
+
+static const int kMaxStreams = 4096;
+static const int kMaxUnpackedSize = 1 << 22;
+
+struct Stream {
+	const uint8_t *src;
+	int srcSize;
+	int size;
+};
+
+static Stream _streams[kMaxStreams];
+static int _streamsCount;
+static uint8_t *_refBuffer;
+static uint8_t *_buffer;
+
+static void addStream(const char *name, const uint8_t *src, int srcSize) {
+	if (srcSize < 12 || _streamsCount >= kMaxStreams) {
+		return;
+	}
+	const int size = READ_BE_UINT32(src + srcSize - 4);
+	if (size <= 0 || size > kMaxUnpackedSize) {
+		return;
+	}
+	if (!bytekiller_unpack_ref(_refBuffer, size, src, srcSize)) {
+		warning("Bad CRC for '%s' stream, size %d", name, size);
+		return;
+	}
+	Stream *s = &_streams[_streamsCount++];
+	s->src = src;
+	s->srcSize = srcSize;
+	s->size = size;
+}
+
+// same table as Resource::unpackBankData(), the raw entries are skipped
+static void addBankStreams(const char *name, const uint8_t *mbk, int mbkSize) {
+	const int count = (READ_BE_UINT32(mbk) & 0xFFFF) / 6;
+	for (int num = 0; num < count && (num + 1) * 6 <= mbkSize; ++num) {
+		const uint8_t *ptr = mbk + num * 6;
+		// the first byte of the dos files is the entries count
+		const uint32_t dataOffset = READ_BE_UINT32(ptr) & 0xFFFFFF;
+		const int len = READ_BE_UINT16(ptr + 4);
+		if ((len & 0x8000) != 0 || len == 0 || dataOffset <= 4 || dataOffset > (uint32_t)mbkSize) {
+			continue;
+		}
+		if ((int)READ_BE_UINT32(mbk + dataOffset - 4) == len * 32) {
+			addStream(name, mbk, dataOffset);
+		}
+	}
+}
+
+static bool hasExtension(const char *name, const char *ext) {
+	const char *p = strrchr(name, '.');
+	return p && strcasecmp(p + 1, ext) == 0;
+}
+
+static uint8_t *loadFile(const char *path, int *size) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	*size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	uint8_t *p = (uint8_t *)malloc(*size);
+	if (p && fread(p, 1, *size, fp) != (size_t)*size) {
+		free(p);
+		p = 0;
+	}
+	fclose(fp);
+	return p;
+}
+
+static double measure(bool (*unpack)(uint8_t *, int, const uint8_t *, int), uint8_t *dst, uint64_t *bytesCount) {
+	const clock_t start = clock();
+	clock_t end;
+	*bytesCount = 0;
+	do {
+		for (int i = 0; i < _streamsCount; ++i) {
+			unpack(dst, _streams[i].size, _streams[i].src, _streams[i].srcSize);
+			*bytesCount += _streams[i].size;
+		}
+		end = clock();
+	} while (end - start < CLOCKS_PER_SEC / 2);
+	return (end - start) / (double)CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s DATA\n", argv[0]);
+		return 1;
+	}
+	_refBuffer = (uint8_t *)malloc(kMaxUnpackedSize);
+	_buffer = (uint8_t *)malloc(kMaxUnpackedSize);
+	if (!_refBuffer || !_buffer) {
+		error("Unable to allocate unpack buffers");
+	}
+	DIR *d = opendir(argv[1]);
+	if (!d) {
+		error("Unable to open directory '%s'", argv[1]);
+	}
+	int packedSize = 0;
+	dirent *de;
+	while ((de = readdir(d)) != 0) {
+		const bool isBank = hasExtension(de->d_name, "MBK");
+		if (!isBank && !hasExtension(de->d_name, "CT") && !hasExtension(de->d_name, "SGD") && !hasExtension(de->d_name, "SPM")) {
+			continue;
+		}
+		char path[MAXPATHLEN];
+		snprintf(path, sizeof(path), "%s/%s", argv[1], de->d_name);
+		int size;
+		uint8_t *p = loadFile(path, &size);
+		if (!p) {
+			warning("Unable to read '%s'", path);
+			continue;
+		}
+		const int count = _streamsCount;
+		if (isBank) {
+			addBankStreams(de->d_name, p, size);
+		} else {
+			addStream(de->d_name, p, size);
+		}
+		if (_streamsCount == count) {
+			free(p);
+		}
+		packedSize += size;
+	}
+	closedir(d);
+	if (_streamsCount == 0) {
+		fprintf(stderr, "No packed data found in '%s'\n", argv[1]);
+		return 1;
+	}
+	int unpackedSize = 0;
+	for (int i = 0; i < _streamsCount; ++i) {
+		const Stream *s = &_streams[i];
+		bytekiller_unpack_ref(_refBuffer, s->size, s->src, s->srcSize);
+		if (!bytekiller_unpack(_buffer, s->size, s->src, s->srcSize) || memcmp(_refBuffer, _buffer, s->size) != 0) {
+			fprintf(stderr, "Stream %d: output differs from the reference decoder\n", i);
+			return 1;
+		}
+		unpackedSize += s->size;
+	}
+	printf("%d streams, %d KB in the files, %d KB unpacked\n", _streamsCount, packedSize / 1024, unpackedSize / 1024);
+	uint64_t refBytes, bytes;
+	const double refSeconds = measure(bytekiller_unpack_ref, _refBuffer, &refBytes);
+	const double seconds = measure(bytekiller_unpack, _buffer, &bytes);
+	const double refRate = refBytes / refSeconds / (1 << 20);
+	const double rate = bytes / seconds / (1 << 20);
+	printf("reference %.1f MB/s, bytekiller_unpack %.1f MB/s (x%.2f)\n", refRate, rate, rate / refRate);
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "resampler.h"
+#include "util.h"
+
+// a constant 8-bit signal must expand to the same 16-bit value as S8_to_S16(), at any position and step
+static int checkConstant(int quality, int value) {
+	static const int kLen = 64;
+	static const int kCount = 256;
+	uint8_t src[kLen];
+	memset(src, (uint8_t)value, sizeof(src));
+	static const uint32_t steps[] = { 1 << (kResampleFracBits - 1), 3 << (kResampleFracBits - 2), 1 << kResampleFracBits, 5 << (kResampleFracBits - 1) };
+	int errors = 0;
+	for (int i = 0; i < ARRAYSIZE(steps); ++i) {
+		const uint32_t inc = steps[i];
+		const int count = MIN(kCount, (int)(((kLen - 1) << kResampleFracBits) / inc));
+		int16_t dst[kCount];
+		setResampleQuality(quality);
+		resampleS8(dst, src, kLen, 0, inc, count);
+		for (int j = 0; j < count; ++j) {
+			if (dst[j] != S8_to_S16(value)) {
+				fprintf(stderr, "quality %d value %d step 0x%X: sample %d is %d, expected %d\n", quality, value, inc, j, dst[j], S8_to_S16(value));
+				++errors;
+				break;
+			}
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char *argv[]) {
+	int errors = 0;
+	for (int quality = kResampleNearest; quality <= kResamplePolyphase; ++quality) {
+		for (int value = -128; value <= 127; ++value) {
+			errors += checkConstant(quality, value);
+		}
+	}
+	if (errors != 0) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "unpack.h"
+#include "unpack_ref.h"
+#include "util.h"
+
+static const int kMaxSize = 4096;
+// the corrupted streams may read more words than they have and copy from past the end of the output
+static const int kPadSize = 16384;
+
+static uint32_t _rndSeed = 0x12345678;
+
+static uint32_t rnd() {
+	_rndSeed ^= _rndSeed << 13;
+	_rndSeed ^= _rndSeed >> 17;
+	_rndSeed ^= _rndSeed << 5;
+	return _rndSeed;
+}
+
+static void writeBE32(uint8_t *p, uint32_t value) {
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+// bits in the decoder reading order, the values are read msb first
+struct Packer {
+	uint8_t bits[kMaxSize * 16];
+	int bitsCount;
+	uint8_t literals[kMaxSize];
+	int literalsCount;
+
+	void putBits(uint32_t value, int count) {
+		for (int i = count - 1; i >= 0; --i) {
+			bits[bitsCount++] = (value >> i) & 1;
+		}
+	}
+	void flushLiterals() {
+		for (int i = 0; i < literalsCount; ) {
+			int len = literalsCount - i;
+			if (len >= 9) {
+				len = MIN(len, 264);
+				putBits(7, 3);
+				putBits(len - 9, 8);
+			} else {
+				putBits(0, 2);
+				putBits(len - 1, 3);
+			}
+			for (int j = 0; j < len; ++j) {
+				putBits(literals[i + j], 8);
+			}
+			i += len;
+		}
+		literalsCount = 0;
+	}
+	// the output is decoded from its end, the references point to the bytes above
+	int pack(const uint8_t *data, int size, uint8_t *dst) {
+		bitsCount = literalsCount = 0;
+		for (int pos = size - 1; pos >= 0; ) {
+			int matchLen = 0;
+			int matchOffset = 0;
+			for (int offset = 1; offset < 4096 && pos + offset < size; ++offset) {
+				int len = 0;
+				while (len < 256 && pos - len >= 0 && data[pos - len] == data[pos - len + offset]) {
+					++len;
+				}
+				if (len > matchLen) {
+					matchLen = len;
+					matchOffset = offset;
+				}
+			}
+			if (matchLen >= 5) {
+				flushLiterals();
+				putBits(6, 3);
+				putBits(matchLen - 1, 8);
+				putBits(matchOffset, 12);
+			} else if (matchLen == 4 && matchOffset < 1024) {
+				flushLiterals();
+				putBits(5, 3);
+				putBits(matchOffset, 10);
+			} else if (matchLen >= 3 && matchOffset < 512) {
+				flushLiterals();
+				matchLen = 3;
+				putBits(4, 3);
+				putBits(matchOffset, 9);
+			} else if (matchLen >= 2 && matchOffset < 256) {
+				flushLiterals();
+				matchLen = 2;
+				putBits(1, 2);
+				putBits(matchOffset, 8);
+			} else {
+				literals[literalsCount++] = data[pos];
+				matchLen = 1;
+			}
+			pos -= matchLen;
+		}
+		flushLiterals();
+		// the first word holds the remaining bits under a marker bit, the words are stored from the end
+		const int firstBitsCount = bitsCount % 32;
+		const int wordsCount = 1 + bitsCount / 32;
+		uint32_t crc = 0;
+		const uint8_t *p = bits;
+		for (int i = 0; i < wordsCount; ++i) {
+			const int count = (i == 0) ? firstBitsCount : 32;
+			uint32_t word = (i == 0) ? (1 << firstBitsCount) : 0;
+			for (int j = 0; j < count; ++j) {
+				word |= *p++ << j;
+			}
+			writeBE32(dst + (wordsCount - 1 - i) * 4, word);
+			crc ^= word;
+		}
+		writeBE32(dst + wordsCount * 4, crc);
+		writeBE32(dst + wordsCount * 4 + 4, size);
+		return wordsCount * 4 + 8;
+	}
+};
+
+static Packer _packer;
+
+// the decoders must agree on the output, including the bytes written before a bad crc is detected, and on the crc check
+static bool compareDecoders(const uint8_t *src, int srcSize, int size) {
+	static uint8_t refBuffer[kMaxSize + kPadSize];
+	static uint8_t buffer[kMaxSize + kPadSize];
+	for (int i = 0; i < size + kPadSize; ++i) {
+		refBuffer[i] = buffer[i] = rnd();
+	}
+	const bool refRet = bytekiller_unpack_ref(refBuffer, size, src, srcSize);
+	const bool ret = bytekiller_unpack(buffer, size, src, srcSize);
+	return refRet == ret && memcmp(refBuffer, buffer, size + kPadSize) == 0;
+}
+
+static int checkRandomStreams(int count) {
+	static uint8_t src[kPadSize + kMaxSize * 2 + 8];
+	int errors = 0;
+	for (int i = 0; i < count; ++i) {
+		const int size = 1 + rnd() % kMaxSize;
+		// 13 bits per output byte at most, a single byte literal
+		const int srcSize = kPadSize + size * 2 + 8;
+		for (int j = 0; j < srcSize - 4; ++j) {
+			src[j] = rnd();
+		}
+		writeBE32(src + srcSize - 4, size);
+		if (!compareDecoders(src, srcSize, size)) {
+			fprintf(stderr, "random stream %d: size %d, decoders mismatch\n", i, size);
+			++errors;
+		}
+	}
+	return errors;
+}
+
+static int checkPackedStreams(int count) {
+	static uint8_t data[kMaxSize];
+	static uint8_t unpacked[kMaxSize];
+	static uint8_t src[kPadSize + kMaxSize * 2 + 8];
+	int errors = 0;
+	for (int i = 0; i < count; ++i) {
+		const int size = 1 + rnd() % kMaxSize;
+		const int colors = 1 + rnd() % 16;
+		for (int j = 0; j < size; ++j) {
+			data[j] = (j != 0 && (rnd() % 3) != 0) ? data[j - 1] : rnd() % colors;
+		}
+		memset(src, 0, kPadSize);
+		const int srcSize = kPadSize + _packer.pack(data, size, src + kPadSize);
+		if (!bytekiller_unpack(unpacked, size, src, srcSize) || memcmp(unpacked, data, size) != 0) {
+			fprintf(stderr, "packed stream %d: size %d, bad output\n", i, size);
+			++errors;
+			continue;
+		}
+		if (!compareDecoders(src, srcSize, size)) {
+			fprintf(stderr, "packed stream %d: size %d, decoders mismatch\n", i, size);
+			++errors;
+		}
+		// flip a bit of the words or of the crc, the unpacked size is left as is
+		const int bit = rnd() % ((srcSize - kPadSize - 4) * 8);
+		src[kPadSize + bit / 8] ^= 1 << (bit & 7);
+		if (!compareDecoders(src, srcSize, size)) {
+			fprintf(stderr, "packed stream %d: size %d, bit %d flipped, decoders mismatch\n", i, size, bit);
+			++errors;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char *argv[]) {
+	int errors = 0;
+	errors += checkRandomStreams(5000);
+	errors += checkPackedStreams(500);
+	if (errors != 0) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	return 0;
+}
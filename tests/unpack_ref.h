@@ -0,0 +1,15 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef UNPACK_REF_H__
+#define UNPACK_REF_H__
+
+#include "intern.h"
+
+// the original bit at a time decoder, kept as a reference for bytekiller_unpack()
+extern bool bytekiller_unpack_ref(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize);
+
+#endif // UNPACK_REF_H__
@@ -7,32 +7,41 @@
 #include "unpack.h"
 #include "util.h"
 
+// the stream words are consumed from their lsb, they are bit reversed when loaded
+// so that the next bits to read are always the msb of the 64 bits buffer
 struct UnpackCtx {
 	int size;
 	uint32_t crc;
-	uint32_t bits;
+	uint64_t bits;
+	int bitsCount;
 	uint8_t *dst;
 	const uint8_t *src;
 };
 
-static bool nextBit(UnpackCtx *uc) {
-	bool bit = (uc->bits & 1) != 0;
-	uc->bits >>= 1;
-	if (uc->bits == 0) { // getnextlwd
+static uint32_t reverseBits(uint32_t x) {
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+	x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// a word is only read when a bit is needed, as the original code, so the crc covers the same words
+static inline void refill(UnpackCtx *uc, int count) { // getnextlwd
+	if (uc->bitsCount < count) {
 		const uint32_t bits = READ_BE_UINT32(uc->src); uc->src -= 4;
 		uc->crc ^= bits;
-		bit = (bits & 1) != 0;
-		uc->bits = (1 << 31) | (bits >> 1);
+		uc->bits |= (uint64_t)reverseBits(bits) << (32 - uc->bitsCount);
+		uc->bitsCount += 32;
 	}
-	return bit;
 }
 
 template<int count>
-static uint32_t getBits(UnpackCtx *uc) { // rdd1bits
-	uint32_t bits = 0;
-	for (int i = 0; i < count; ++i) {
-		bits |= (nextBit(uc) ? 1 : 0) << (count - 1 - i);
-	}
+static inline uint32_t getBits(UnpackCtx *uc) { // rdd1bits
+	refill(uc, count);
+	const uint32_t bits = (uint32_t)(uc->bits >> (64 - count));
+	uc->bits <<= count;
+	uc->bitsCount -= count;
 	return bits;
 }
 
@@ -42,10 +51,19 @@ static void copyLiteral(UnpackCtx *uc, int len) { // getd3chr
 		len += uc->size;
 		uc->size = 0;
 	}
-	for (int i = 0; i < len; ++i) {
-		*(uc->dst - i) = (uint8_t)getBits<8>(uc);
-	}
+	uint8_t *dst = uc->dst;
 	uc->dst -= len;
+	for (; len >= 4; len -= 4) {
+		const uint32_t bits = getBits<32>(uc);
+		dst[0] = bits >> 24;
+		dst[-1] = bits >> 16;
+		dst[-2] = bits >> 8;
+		dst[-3] = bits;
+		dst -= 4;
+	}
+	for (; len > 0; --len) {
+		*dst-- = (uint8_t)getBits<8>(uc);
+	}
 }
 
 static void copyReference(UnpackCtx *uc, int len, int offset) { // copyd3bytes
@@ -54,10 +72,14 @@ static void copyReference(UnpackCtx *uc, int len, int offset) { // copyd3bytes
 		len += uc->size;
 		uc->size = 0;
 	}
-	for (int i = 0; i < len; ++i) {
-		*(uc->dst - i) = *(uc->dst - i + offset);
-	}
 	uc->dst -= len;
+	if (offset >= len) {
+		memcpy(uc->dst + 1, uc->dst + 1 + offset, len);
+	} else {
+		for (int i = 0; i < len; ++i) {
+			*(uc->dst + len - i) = *(uc->dst + len - i + offset);
+		}
+	}
 }
 
 bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize) {
@@ -70,11 +92,17 @@ bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSiz
 	}
 	uc.dst = dst + uc.size - 1;
 	uc.crc = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.bits = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.crc ^= uc.bits;
+	const uint32_t bits = READ_BE_UINT32(uc.src); uc.src -= 4;
+	uc.crc ^= bits;
+	// the highest set bit of the first word marks the end of the stream
+	uc.bitsCount = 0;
+	for (uint32_t mask = bits; mask > 1; mask >>= 1) {
+		++uc.bitsCount;
+	}
+	uc.bits = (uint64_t)reverseBits(bits & ((1U << uc.bitsCount) - 1)) << 32;
 	do {
-		if (!nextBit(&uc)) {
-			if (!nextBit(&uc)) {
+		if (!getBits<1>(&uc)) {
+			if (!getBits<1>(&uc)) {
 				copyLiteral(&uc, getBits<3>(&uc) + 1);
 			} else {
 				copyReference(&uc, 2, getBits<8>(&uc));
@@ -8,6 +8,9 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <unistd.h>
+#endif
 #include <stdarg.h>
 #include "util.h"
 
@@ -48,3 +51,18 @@ void warning(const char *msg, ...) {
 	fprintf(stderr, "WARNING: %s!\n", buf);
 }
 
+
+uint32_t getResidentMemoryKb() {
+	uint32_t kb = 0;
+#ifdef __linux__
+	FILE *fp = fopen("/proc/self/statm", "r");
+	if (fp) {
+		unsigned long size, resident;
+		if (fscanf(fp, "%lu %lu", &size, &resident) == 2) {
+			kb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+		}
+		fclose(fp);
+	}
+#endif
+	return kb;
+}
@@ -32,4 +32,7 @@ extern void debug(uint16_t cm, const char *msg, ...); // __attribute__((__format
 extern void error(const char *msg, ...);              // __attribute__((__format__(__printf__, 1, 2)))
 extern void warning(const char *msg, ...);            // __attribute__((__format__(__printf__, 1, 2)))
 
+// resident set size of the process in KB, 0 if unavailable
+extern uint32_t getResidentMemoryKb();
+
 #endif // UTIL_H__
@@ -4,6 +4,7 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <SDL.h>
 #include "resource.h"
 #include "systemstub.h"
 #include "unpack.h"
@@ -27,6 +28,13 @@ Video::Video(Resource *res, SystemStub *stub)
 	_charTransparentColor = 0;
 	_charShadowColor = 0;
 	_drawChar = 0;
+	_roomCache = 0;
+	_roomCacheSize = 0;
+	_roomCacheCounter = 0;
+	_roomCacheHits = _roomCacheMisses = 0;
+	memset(&_roomBuffers, 0, sizeof(_roomBuffers));
+	_levelRooms = 0;
+	_levelRoomsCount = 0;
 	switch (_res->_type) {
 	case kResourceTypeAmiga:
 		_drawChar = &Video::AMIGA_drawStringChar;
@@ -43,6 +51,12 @@ Video::~Video() {
 	free(_tempLayer);
 	free(_tempLayer2);
 	free(_screenBlocks);
+	if (_roomCache) {
+		free(_roomCache[0].layer);
+		free(_roomCache);
+	}
+	freeLevelRooms();
+	free(_roomBuffers.data);
 }
 
 void Video::markBlockAsDirty(int16_t x, int16_t y, uint16_t w, uint16_t h, int scale) {
@@ -196,13 +210,232 @@ void Video::setPalette0xF() {
 	}
 }
 
-void Video::PC_decodeLev(int level, int room) {
-	uint8_t *tmp = _res->_mbk;
-	_res->_mbk = _res->_bnq;
-	_res->clearBankData();
-	AMIGA_decodeLev(level, room);
-	_res->_mbk = tmp;
-	_res->clearBankData();
+static const int kRoomTilesSize = 1024 * 32;
+
+static bool allocRoomBuffers(RoomBuffers *rb) {
+	uint8_t *p = (uint8_t *)malloc(Resource::kScratchBufferSize + kRoomTilesSize + Resource::kBankDataSize);
+	if (!p) {
+		return false;
+	}
+	rb->data = p;
+	rb->tiles = rb->data + Resource::kScratchBufferSize;
+	rb->bank = rb->tiles + kRoomTilesSize;
+	return true;
+}
+
+bool Video::decodeRoom(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb) {
+	switch (_res->_type) {
+	case kResourceTypeAmiga:
+		return AMIGA_decodeLev(level, room, _res->_mbk, dst, palSlots, rb);
+	case kResourceTypeDOS:
+		return PC_decodeMap(level, room, dst, palSlots, rb);
+	}
+	return false;
+}
+
+// decodes to the front layer
+bool Video::decodeRoom(int level, int room) {
+	if (!_roomBuffers.data && !allocRoomBuffers(&_roomBuffers)) {
+		error("Unable to allocate room decoding buffers");
+	}
+	uint8_t palSlots[4];
+	if (!decodeRoom(level, room, _frontLayer, palSlots, &_roomBuffers)) {
+		return false;
+	}
+	_mapPalSlot1 = palSlots[0];
+	_mapPalSlot2 = palSlots[1];
+	_mapPalSlot3 = palSlots[2];
+	_mapPalSlot4 = palSlots[3];
+	return true;
+}
+
+struct PredecodeContext {
+	Video *vid;
+	int level;
+	const uint8_t *rooms;
+	int count;
+	SDL_atomic_t next;
+};
+
+static void predecodeLoop(PredecodeContext *ctx, RoomBuffers *rb) {
+	int i;
+	while ((i = SDL_AtomicAdd(&ctx->next, 1)) < ctx->count) {
+		RoomCacheEntry *e = &ctx->vid->_levelRooms[i];
+		if (ctx->vid->decodeRoom(ctx->level, ctx->rooms[i], e->layer, e->palSlots, rb)) {
+			e->level = ctx->level;
+		}
+	}
+}
+
+static int predecodeThread(void *param) {
+	RoomBuffers rb;
+	if (allocRoomBuffers(&rb)) {
+		predecodeLoop((PredecodeContext *)param, &rb);
+		free(rb.data);
+	}
+	return 0;
+}
+
+// decodes all the rooms of the level on worker threads, room changes then only copy the layer
+void Video::predecodeRooms(int level, const uint8_t *rooms, int count) {
+	freeLevelRooms();
+	if (count == 0) {
+		return;
+	}
+	_levelRooms = (RoomCacheEntry *)calloc(count, sizeof(RoomCacheEntry));
+	uint8_t *layers = (uint8_t *)malloc(count * _layerSize);
+	if (!_levelRooms || !layers) {
+		warning("Unable to allocate %d predecoded rooms", count);
+		free(_levelRooms);
+		_levelRooms = 0;
+		free(layers);
+		return;
+	}
+	for (int i = 0; i < count; ++i) {
+		_levelRooms[i].level = -1;
+		_levelRooms[i].room = rooms[i];
+		_levelRooms[i].layer = layers + i * _layerSize;
+	}
+	_levelRoomsCount = count;
+	if (!_roomBuffers.data && !allocRoomBuffers(&_roomBuffers)) {
+		error("Unable to allocate room decoding buffers");
+	}
+	const uint64_t t0 = SDL_GetPerformanceCounter();
+	PredecodeContext ctx;
+	ctx.vid = this;
+	ctx.level = level;
+	ctx.rooms = rooms;
+	ctx.count = count;
+	SDL_AtomicSet(&ctx.next, 0);
+	static const int kMaxThreads = 8;
+	SDL_Thread *threads[kMaxThreads];
+	// the calling thread is one of the workers
+	const int threadsCount = MIN(MIN(SDL_GetCPUCount(), count), kMaxThreads) - 1;
+	int started = 0;
+	for (; started < threadsCount; ++started) {
+		threads[started] = SDL_CreateThread(predecodeThread, "room_decode", &ctx);
+		if (!threads[started]) {
+			warning("Unable to create room decoding thread");
+			break;
+		}
+	}
+	predecodeLoop(&ctx, &_roomBuffers);
+	for (int i = 0; i < started; ++i) {
+		SDL_WaitThread(threads[i], 0);
+	}
+	const double ms = (SDL_GetPerformanceCounter() - t0) * 1000. / SDL_GetPerformanceFrequency();
+	debug(DBG_INFO, "Decoded %d rooms of level %d in %.1f ms with %d threads (%d KB)", count, level, ms, started + 1, count * _layerSize / 1024);
+}
+
+void Video::freeLevelRooms() {
+	if (_levelRooms) {
+		free(_levelRooms[0].layer);
+		free(_levelRooms);
+		_levelRooms = 0;
+	}
+	_levelRoomsCount = 0;
+}
+
+bool Video::loadRoomFromCache(int level, int room) {
+	for (int i = 0; i < _levelRoomsCount; ++i) {
+		const RoomCacheEntry *e = &_levelRooms[i];
+		if (e->level == level && e->room == room) {
+			memcpy(_frontLayer, e->layer, _layerSize);
+			_mapPalSlot1 = e->palSlots[0];
+			_mapPalSlot2 = e->palSlots[1];
+			_mapPalSlot3 = e->palSlots[2];
+			_mapPalSlot4 = e->palSlots[3];
+			++_roomCacheHits;
+			return true;
+		}
+	}
+	for (int i = 0; i < _roomCacheSize; ++i) {
+		RoomCacheEntry *e = &_roomCache[i];
+		if (e->level == level && e->room == room) {
+			memcpy(_frontLayer, e->layer, _layerSize);
+			_mapPalSlot1 = e->palSlots[0];
+			_mapPalSlot2 = e->palSlots[1];
+			_mapPalSlot3 = e->palSlots[2];
+			_mapPalSlot4 = e->palSlots[3];
+			e->lastUse = ++_roomCacheCounter;
+			++_roomCacheHits;
+			return true;
+		}
+	}
+	++_roomCacheMisses;
+	return false;
+}
+
+// keeps the decoded room layer and its palette slots, the least recently used room is replaced
+void Video::storeRoomInCache(int level, int room) {
+	if (!_roomCache && g_options.room_cache_size > 0) {
+		const int count = g_options.room_cache_size;
+		_roomCache = (RoomCacheEntry *)calloc(count, sizeof(RoomCacheEntry));
+		uint8_t *layers = (uint8_t *)malloc(count * _layerSize);
+		if (!_roomCache || !layers) {
+			warning("Unable to allocate %d rooms cache", count);
+			free(_roomCache);
+			_roomCache = 0;
+			free(layers);
+			return;
+		}
+		for (int i = 0; i < count; ++i) {
+			_roomCache[i].level = _roomCache[i].room = -1;
+			_roomCache[i].layer = layers + i * _layerSize;
+		}
+		_roomCacheSize = count;
+	}
+	if (_roomCacheSize == 0) {
+		return;
+	}
+	RoomCacheEntry *e = &_roomCache[0];
+	for (int i = 1; i < _roomCacheSize; ++i) {
+		if (_roomCache[i].lastUse < e->lastUse) {
+			e = &_roomCache[i];
+		}
+	}
+	e->level = level;
+	e->room = room;
+	e->lastUse = ++_roomCacheCounter;
+	e->palSlots[0] = _mapPalSlot1;
+	e->palSlots[1] = _mapPalSlot2;
+	e->palSlots[2] = _mapPalSlot3;
+	e->palSlots[3] = _mapPalSlot4;
+	memcpy(e->layer, _frontLayer, _layerSize);
+}
+
+void Video::dumpRoomCacheStats() {
+	const uint32_t total = _roomCacheHits + _roomCacheMisses;
+	if (total != 0) {
+		debug(DBG_INFO, "Rooms cache: %d hits, %d misses (%.1f%% hit rate, %d entries)", _roomCacheHits, _roomCacheMisses, _roomCacheHits * 100. / total, _roomCacheSize);
+	}
+}
+
+void Video::setLevelPalettes(int level) {
+	if (_res->isDOS()) {
+		PC_setLevelPalettes();
+		if (level == 0 && !_res->_map) { // .LEV tiles with color slot 0x9
+			setPaletteSlotBE(0x9, _mapPalSlot1);
+		}
+		return;
+	}
+	// background
+	setPaletteSlotBE(0x0, _mapPalSlot1);
+	// objects
+	setPaletteSlotBE(0x1, (level == 0) ? _mapPalSlot3 : _mapPalSlot2);
+	setPaletteSlotBE(0x2, _mapPalSlot3);
+	setPaletteSlotBE(0x3, _mapPalSlot3);
+	// conrad
+	setPaletteSlotBE(0x4, _mapPalSlot3);
+	// foreground
+	setPaletteSlotBE(0x8, _mapPalSlot1);
+	setPaletteSlotBE(0x9, (level == 0) ? _mapPalSlot1 : _mapPalSlot3);
+	// inventory
+	setPaletteSlotBE(0xA, _mapPalSlot3);
+}
+
+bool Video::PC_decodeLev(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb) {
+	return AMIGA_decodeLev(level, room, _res->_bnq, dst, palSlots, rb);
 }
 
 static void PC_decodeMapPlane(int sz, const uint8_t *src, uint8_t *dst) {
@@ -222,12 +455,11 @@ static void PC_decodeMapPlane(int sz, const uint8_t *src, uint8_t *dst) {
 	}
 }
 
-void Video::PC_decodeMap(int level, int room) {
+bool Video::PC_decodeMap(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb) {
 	debug(DBG_VIDEO, "Video::PC_decodeMap(%d)", room);
 	if (!_res->_map) {
 		assert(_res->_lev);
-		PC_decodeLev(level, room);
-		return;
+		return PC_decodeLev(level, room, dst, palSlots, rb);
 	}
 	assert(room < 0x40);
 	int32_t off = READ_LE_UINT32(_res->_map + room * 6);
@@ -241,32 +473,30 @@ void Video::PC_decodeMap(int level, int room) {
 		packed = false;
 	}
 	const uint8_t *p = _res->_map + off;
-	_mapPalSlot1 = *p++;
-	_mapPalSlot2 = *p++;
-	_mapPalSlot3 = *p++;
-	_mapPalSlot4 = *p++;
+	for (int i = 0; i < 4; ++i) {
+		palSlots[i] = *p++;
+	}
 	if (level == 4 && room == 60) {
 		// workaround for wrong palette colors (fire)
-		_mapPalSlot4 = 5;
+		palSlots[3] = 5;
 	}
 	static const int kPlaneSize = 256 * 224 / 4;
 	if (packed) {
 		for (int i = 0; i < 4; ++i) {
 			const int sz = READ_LE_UINT16(p); p += 2;
-			PC_decodeMapPlane(sz, p, _res->_scratchBuffer); p += sz;
-			memcpy(_frontLayer + i * kPlaneSize, _res->_scratchBuffer, kPlaneSize);
+			PC_decodeMapPlane(sz, p, rb->data); p += sz;
+			memcpy(dst + i * kPlaneSize, rb->data, kPlaneSize);
 		}
 	} else {
 		for (int i = 0; i < 4; ++i) {
 			for (int y = 0; y < 224; ++y) {
 				for (int x = 0; x < 64; ++x) {
-					_frontLayer[i + x * 4 + 256 * y] = p[kPlaneSize * i + x + 64 * y];
+					dst[i + x * 4 + 256 * y] = p[kPlaneSize * i + x + 64 * y];
 				}
 			}
 		}
 	}
-	memcpy(_backLayer, _frontLayer, _layerSize);
-	PC_setLevelPalettes();
+	return true;
 }
 
 void Video::PC_setLevelPalettes() {
@@ -521,10 +751,8 @@ static void decodeSgd(uint8_t *dst, const uint8_t *src, const uint8_t *data, con
 	} while (--count >= 0);
 }
 
-static const uint8_t *AMIGA_mirrorTileY(const uint8_t *a2) {
-	static uint8_t buf[32];
-
-        a2 += 24;
+static const uint8_t *AMIGA_mirrorTileY(const uint8_t *a2, uint8_t *buf) {
+	a2 += 24;
 	for (int j = 0; j < 4; ++j) {
 		for (int i = 0; i < 8; ++i) {
 			buf[31 - j * 8 - i] = *a2++;
@@ -534,9 +762,7 @@ static const uint8_t *AMIGA_mirrorTileY(const uint8_t *a2) {
 	return buf;
 }
 
-static const uint8_t *AMIGA_mirrorTileX(const uint8_t *a2) {
-	static uint8_t buf[32];
-
+static const uint8_t *AMIGA_mirrorTileX(const uint8_t *a2, uint8_t *buf) {
 	for (int i = 0; i < 32; ++i) {
 		uint8_t mask = 0;
 		for (int bit = 0; bit < 8; ++bit) {
@@ -550,11 +776,12 @@ static const uint8_t *AMIGA_mirrorTileX(const uint8_t *a2) {
 }
 
 static void AMIGA_drawTile(uint8_t *dst, int pitch, const uint8_t *src, int pal, const bool xflip, const bool yflip, int colorKey) {
+	uint8_t bufY[32], bufX[32];
 	if (yflip) {
-		src = AMIGA_mirrorTileY(src);
+		src = AMIGA_mirrorTileY(src, bufY);
 	}
 	if (xflip) {
-		src = AMIGA_mirrorTileX(src);
+		src = AMIGA_mirrorTileX(src, bufX);
 	}
 	for (int y = 0; y < 8; ++y) {
 		for (int i = 0; i < 8; ++i) {
@@ -655,21 +882,19 @@ static void decodeLevHelper(uint8_t *dst, const uint8_t *src, int offset10, int
 	}
 }
 
-void Video::AMIGA_decodeLev(int level, int room) {
-	uint8_t *tmp = _res->_scratchBuffer;
+bool Video::AMIGA_decodeLev(int level, int room, const uint8_t *mbk, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb) {
+	uint8_t *tmp = rb->data;
 	const int offset = READ_BE_UINT32(_res->_lev + room * 4);
 	if (!bytekiller_unpack(tmp, Resource::kScratchBufferSize, _res->_lev, offset)) {
 		warning("Bad CRC for level %d room %d", level, room);
-		return;
+		return false;
 	}
 	uint16_t offset10 = READ_BE_UINT16(tmp + 10);
 	const uint16_t offset12 = READ_BE_UINT16(tmp + 12);
 	const uint16_t offset14 = READ_BE_UINT16(tmp + 14);
-	static const int kTempMbkSize = 1024;
-	uint8_t *buf = (uint8_t *)malloc(kTempMbkSize * 32);
-	if (!buf) {
-		error("Unable to allocate mbk temporary buffer");
-	}
+	// the bank data cache is only used from the main thread, the worker threads unpack to their own buffer
+	const bool useBankCache = (rb == &_roomBuffers) && (mbk == _res->_mbk);
+	uint8_t *buf = rb->tiles;
 	int sz = 0;
 	memset(buf, 0, 32);
 	sz += 32;
@@ -680,58 +905,45 @@ void Video::AMIGA_decodeLev(int level, int room) {
 			d0 &= ~0x8000;
 			loop = false;
 		}
-		const int d1 = _res->getBankDataSize(d0);
-		const uint8_t *a6 = _res->findBankData(d0);
-		if (!a6) {
-			a6 = _res->loadBankData(d0);
+		const int d1 = _res->getBankDataSize(mbk, d0);
+		const uint8_t *a6;
+		if (useBankCache) {
+			a6 = _res->findBankData(d0);
+			if (!a6) {
+				a6 = _res->loadBankData(d0);
+			}
+		} else {
+			a6 = _res->findPredecodedBankData(mbk, d0);
+			if (!a6) {
+				_res->unpackBankData(mbk, d0, rb->bank, Resource::kBankDataSize);
+				a6 = rb->bank;
+			}
 		}
 		const int d3 = *a1++;
 		if (d3 == 255) {
-			assert(sz + d1 <= kTempMbkSize * 32);
+			assert(sz + d1 <= kRoomTilesSize);
 			memcpy(buf + sz, a6, d1);
 			sz += d1;
 		} else {
 			for (int i = 0; i < d3 + 1; ++i) {
 				const int d4 = *a1++;
-				assert(sz + 32 <= kTempMbkSize * 32);
+				assert(sz + 32 <= kRoomTilesSize);
 				memcpy(buf + sz, a6 + d4 * 32, 32);
 				sz += 32;
 			}
 		}
 	}
-	memset(_frontLayer, 0, _layerSize);
+	memset(dst, 0, _layerSize);
 	if (tmp[1] != 0) {
 		assert(_res->_sgd);
-		decodeSgd(_frontLayer, tmp + offset10, _res->_sgd, _res->isAmiga());
+		decodeSgd(dst, tmp + offset10, _res->_sgd, _res->isAmiga());
 		offset10 = 0;
 	}
-	decodeLevHelper(_frontLayer, tmp, offset10, offset12, buf, tmp[1] != 0, _res->isDOS());
-	free(buf);
-	memcpy(_backLayer, _frontLayer, _layerSize);
-	_mapPalSlot1 = READ_BE_UINT16(tmp + 2);
-	_mapPalSlot2 = READ_BE_UINT16(tmp + 4);
-	_mapPalSlot3 = READ_BE_UINT16(tmp + 6);
-	_mapPalSlot4 = READ_BE_UINT16(tmp + 8);
-	if (_res->isDOS()) {
-		PC_setLevelPalettes();
-		if (level == 0) { // tiles with color slot 0x9
-			setPaletteSlotBE(0x9, _mapPalSlot1);
-		}
-		return;
+	decodeLevHelper(dst, tmp, offset10, offset12, buf, tmp[1] != 0, _res->isDOS());
+	for (int i = 0; i < 4; ++i) {
+		palSlots[i] = READ_BE_UINT16(tmp + 2 + i * 2);
 	}
-	// background
-	setPaletteSlotBE(0x0, _mapPalSlot1);
-	// objects
-	setPaletteSlotBE(0x1, (level == 0) ? _mapPalSlot3 : _mapPalSlot2);
-	setPaletteSlotBE(0x2, _mapPalSlot3);
-	setPaletteSlotBE(0x3, _mapPalSlot3);
-	// conrad
-	setPaletteSlotBE(0x4, _mapPalSlot3);
-	// foreground
-	setPaletteSlotBE(0x8, _mapPalSlot1);
-	setPaletteSlotBE(0x9, (level == 0) ? _mapPalSlot1 : _mapPalSlot3);
-	// inventory
-	setPaletteSlotBE(0xA, _mapPalSlot3);
+	return true;
 }
 
 void Video::AMIGA_decodeSpm(const uint8_t *src, uint8_t *dst) {
@@ -12,6 +12,20 @@
 struct Resource;
 struct SystemStub;
 
+// working memory of a room decoder, each thread has its own
+struct RoomBuffers {
+	uint8_t *data;  // unpacked room data or .MAP plane
+	uint8_t *tiles; // room tiles assembled from the bank entries
+	uint8_t *bank;  // unpacked bank entry
+};
+
+struct RoomCacheEntry {
+	int level, room;
+	uint32_t lastUse;
+	uint8_t palSlots[4];
+	uint8_t *layer;
+};
+
 struct Video {
 	typedef void (Video::*drawCharFunc)(uint8_t *, int, int, int, const uint8_t *, uint8_t, uint8_t);
 
@@ -49,6 +63,13 @@ struct Video {
 	bool _fullRefresh;
 	uint8_t _shakeOffset;
 	drawCharFunc _drawChar;
+	RoomCacheEntry *_roomCache;
+	int _roomCacheSize;
+	uint32_t _roomCacheCounter;
+	uint32_t _roomCacheHits, _roomCacheMisses;
+	RoomBuffers _roomBuffers;
+	RoomCacheEntry *_levelRooms;
+	int _levelRoomsCount;
 
 	Video(Resource *res, SystemStub *stub);
 	~Video();
@@ -63,13 +84,21 @@ struct Video {
 	void setPaletteSlotLE(int palSlot, const uint8_t *palData);
 	void setTextPalette();
 	void setPalette0xF();
-	void PC_decodeLev(int level, int room);
-	void PC_decodeMap(int level, int room);
+	bool decodeRoom(int level, int room);
+	bool decodeRoom(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb);
+	void predecodeRooms(int level, const uint8_t *rooms, int count);
+	void freeLevelRooms();
+	bool loadRoomFromCache(int level, int room);
+	void storeRoomInCache(int level, int room);
+	void dumpRoomCacheStats();
+	void setLevelPalettes(int level);
+	bool PC_decodeLev(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb);
+	bool PC_decodeMap(int level, int room, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb);
 	void PC_setLevelPalettes();
 	void PC_decodeIcn(const uint8_t *src, int num, uint8_t *dst);
 	void PC_decodeSpc(const uint8_t *src, int w, int h, uint8_t *dst);
 	void PC_decodeSpm(const uint8_t *dataPtr, uint8_t *dstPtr);
-	void AMIGA_decodeLev(int level, int room);
+	bool AMIGA_decodeLev(int level, int room, const uint8_t *mbk, uint8_t *dst, uint8_t *palSlots, RoomBuffers *rb);
 	void AMIGA_decodeSpm(const uint8_t *src, uint8_t *dst);
 	void AMIGA_decodeIcn(const uint8_t *src, int num, uint8_t *dst);
 	void AMIGA_decodeSpc(const uint8_t *src, int w, int h, uint8_t *dst);